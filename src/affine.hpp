@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "simd.hpp"
+
+namespace otto {
+
+// A 2D affine transform stored as the 2x3 matrix
+//
+//   | a c tx |
+//   | b d ty |
+//
+// which is the layout OpenVG uses for its 3x3 matrices with the projective row dropped.
+struct Affine {
+  float a = 1.0f, b = 0.0f, c = 0.0f, d = 1.0f, tx = 0.0f, ty = 0.0f;
+
+  Affine() = default;
+  Affine(float a, float b, float c, float d, float tx, float ty)
+  : a{ a }, b{ b }, c{ c }, d{ d }, tx{ tx }, ty{ ty } {}
+  explicit Affine(const glm::mat3 &m)
+  : a{ m[0][0] }, b{ m[0][1] }, c{ m[1][0] }, d{ m[1][1] }, tx{ m[2][0] }, ty{ m[2][1] } {}
+
+  static Affine translation(float x, float y) { return { 1.0f, 0.0f, 0.0f, 1.0f, x, y }; }
+  static Affine scaling(float x, float y) { return { x, 0.0f, 0.0f, y, 0.0f, 0.0f }; }
+  static Affine rotation(float radians) {
+    float s = std::sin(radians), co = std::cos(radians);
+    return { co, s, -s, co, 0.0f, 0.0f };
+  }
+
+  glm::mat3 toMat3() const {
+    return glm::mat3(glm::vec3(a, b, 0.0f), glm::vec3(c, d, 0.0f), glm::vec3(tx, ty, 1.0f));
+  }
+
+  // Column-major 3x3 matrix as expected by vgLoadMatrix
+  void toVGMatrix(float *m) const {
+    m[0] = a;  m[1] = b;  m[2] = 0.0f;
+    m[3] = c;  m[4] = d;  m[5] = 0.0f;
+    m[6] = tx; m[7] = ty; m[8] = 1.0f;
+  }
+
+  float determinant() const { return a * d - b * c; }
+
+  // The following post-multiply, matching glm::translate/rotate/scale on a mat3.
+  void translate(float x, float y) {
+    tx += a * x + c * y;
+    ty += b * x + d * y;
+  }
+  void scale(float x, float y) {
+    a *= x; b *= x;
+    c *= y; d *= y;
+  }
+  void rotate(float radians) {
+    float s = std::sin(radians), co = std::cos(radians);
+    float na = a * co + c * s, nb = b * co + d * s;
+    c = c * co - a * s;
+    d = d * co - b * s;
+    a = na;
+    b = nb;
+  }
+
+  glm::vec2 transformPoint(const glm::vec2 &p) const {
+    return { a * p.x + c * p.y + tx, b * p.x + d * p.y + ty };
+  }
+
+  bool operator==(const Affine &o) const {
+    return a == o.a && b == o.b && c == o.c && d == o.d && tx == o.tx && ty == o.ty;
+  }
+  bool operator!=(const Affine &o) const { return !(*this == o); }
+};
+
+// Returns l * r, i.e. r is applied first.
+inline Affine compose(const Affine &l, const Affine &r) {
+  Affine out;
+#if OTTO_GFX_SSE
+  __m128 ab = _mm_setr_ps(l.a, l.b, l.a, l.b);
+  __m128 cd = _mm_setr_ps(l.c, l.d, l.c, l.d);
+  __m128 lin = _mm_add_ps(_mm_mul_ps(ab, _mm_setr_ps(r.a, r.a, r.c, r.c)),
+                          _mm_mul_ps(cd, _mm_setr_ps(r.b, r.b, r.d, r.d)));
+  __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ab, _mm_set1_ps(r.tx)),
+                                   _mm_mul_ps(cd, _mm_set1_ps(r.ty))),
+                        _mm_setr_ps(l.tx, l.ty, 0.0f, 0.0f));
+  _mm_storeu_ps(&out.a, lin);
+  _mm_storel_pi(reinterpret_cast<__m64 *>(&out.tx), t);
+#elif OTTO_GFX_NEON
+  float32x4_t ab = { l.a, l.b, l.a, l.b };
+  float32x4_t cd = { l.c, l.d, l.c, l.d };
+  float32x4_t ra = { r.a, r.a, r.c, r.c };
+  float32x4_t rb = { r.b, r.b, r.d, r.d };
+  float32x4_t lin = vmlaq_f32(vmulq_f32(ab, ra), cd, rb);
+  float32x2_t t = vmla_n_f32(vmla_n_f32(vld1_f32(&l.tx), vget_low_f32(ab), r.tx),
+                             vget_low_f32(cd), r.ty);
+  vst1q_f32(&out.a, lin);
+  vst1_f32(&out.tx, t);
+#else
+  out.a = l.a * r.a + l.c * r.b;
+  out.b = l.b * r.a + l.d * r.b;
+  out.c = l.a * r.c + l.c * r.d;
+  out.d = l.b * r.c + l.d * r.d;
+  out.tx = l.a * r.tx + l.c * r.ty + l.tx;
+  out.ty = l.b * r.tx + l.d * r.ty + l.ty;
+#endif
+  return out;
+}
+
+inline Affine operator*(const Affine &l, const Affine &r) {
+  return compose(l, r);
+}
+
+// Singular transforms invert to a transform that collapses everything onto the origin.
+inline Affine invert(const Affine &m) {
+  float det = m.determinant();
+  float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+  Affine out;
+#if OTTO_GFX_SSE
+  __m128 lin = _mm_mul_ps(_mm_setr_ps(m.d, -m.b, -m.c, m.a), _mm_set1_ps(invDet));
+  _mm_storeu_ps(&out.a, lin);
+#elif OTTO_GFX_NEON
+  float32x4_t lin = { m.d, -m.b, -m.c, m.a };
+  vst1q_f32(&out.a, vmulq_n_f32(lin, invDet));
+#else
+  out.a = m.d * invDet;
+  out.b = -m.b * invDet;
+  out.c = -m.c * invDet;
+  out.d = m.a * invDet;
+#endif
+  out.tx = -(out.a * m.tx + out.c * m.ty);
+  out.ty = -(out.b * m.tx + out.d * m.ty);
+  return out;
+}
+
+// Transforms `count` points from `in` to `out`. The arrays may alias.
+inline void transformPoints(const Affine &m, const glm::vec2 *in, glm::vec2 *out, size_t count) {
+  size_t i = 0;
+  auto src = reinterpret_cast<const float *>(in);
+  auto dst = reinterpret_cast<float *>(out);
+#if OTTO_GFX_SSE
+  __m128 ab = _mm_setr_ps(m.a, m.b, m.a, m.b);
+  __m128 cd = _mm_setr_ps(m.c, m.d, m.c, m.d);
+  __m128 t = _mm_setr_ps(m.tx, m.ty, m.tx, m.ty);
+  for (; i + 2 <= count; i += 2) {
+    __m128 p = _mm_loadu_ps(src + i * 2);
+    __m128 xs = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 ys = _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1));
+    _mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_add_ps(_mm_mul_ps(xs, ab), _mm_mul_ps(ys, cd)), t));
+  }
+#elif OTTO_GFX_NEON
+  for (; i + 4 <= count; i += 4) {
+    // De-interleave four points into xs and ys, then re-interleave the results
+    float32x4x2_t p = vld2q_f32(src + i * 2);
+    float32x4x2_t r;
+    r.val[0] = vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m.tx), p.val[0], m.a), p.val[1], m.c);
+    r.val[1] = vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m.ty), p.val[0], m.b), p.val[1], m.d);
+    vst2q_f32(dst + i * 2, r);
+  }
+#endif
+  for (; i < count; ++i) {
+    float x = src[i * 2], y = src[i * 2 + 1];
+    dst[i * 2] = m.a * x + m.c * y + m.tx;
+    dst[i * 2 + 1] = m.b * x + m.d * y + m.ty;
+  }
+}
+
+} // otto
@@ -1,4 +1,8 @@
 #include "gfx.hpp"
+#include "affine.hpp"
+#include "path_data.hpp"
+#include "stroker.hpp"
+#include "waveform.hpp"
 #define GLM_FORCE_RADIANS 1
 #include <glm/gtx/matrix_transform_2d.hpp>
 
@@ -11,8 +15,13 @@
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "stb_truetype.h"
 
-#include <VG/vgu.h>
+#include <cassert>
+#include <algorithm>
 #include <vector>
+#include <list>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
 #include <cmath>
 #include <fstream>
 #include <iostream>
@@ -27,10 +36,284 @@ struct Mask {
   VGint width, height;
 };
 
+// A CPU-side copy of a piece of OpenVG state. Values start out invalid so the first set is always
+// sent to OpenVG, after which only actual changes are.
+template <typename T>
+struct Shadow {
+  T value;
+  bool valid = false;
+
+  // Returns true if the new value differs from what OpenVG holds and needs to be sent.
+  bool update(const T &v) {
+    if (valid && value == v) return false;
+    value = v;
+    valid = true;
+    return true;
+  }
+};
+
+struct RenderState {
+  Shadow<VGPaint> fillPaint;
+  Shadow<VGPaint> strokePaint;
+  Shadow<VGfloat> strokeWidth;
+  Shadow<VGint> strokeCap;
+  Shadow<VGint> strokeJoin;
+  Shadow<VGint> fillRule;
+  Shadow<VGint> matrixMode;
+  Shadow<Affine> pathMatrix;
+  Shadow<Affine> fillPaintMatrix;
+  Shadow<Affine> strokePaintMatrix;
+  Shadow<std::pair<vec4, vec4>> colorTransform;
+  Shadow<bool> colorTransformEnabled;
+  Shadow<bool> masking;
+  Shadow<vec4> clearColor;
+  Shadow<VGint> blendMode;
+};
+
+// A paint handle along with whether every color it can produce is fully opaque
+struct PaintInfo {
+  VGPaint paint;
+  bool opaque;
+};
+
+struct CachedPaint {
+  VGPaint paint;
+  std::list<uint32_t>::iterator lruPos;
+};
+
+// Solid color paints keyed by packed RGBA. The front of `lru` is the most recently used color.
+struct PaintCache {
+  size_t capacity = 256;
+  std::unordered_map<uint32_t, CachedPaint> paints;
+  std::list<uint32_t> lru;
+  PaintCacheStats stats;
+};
+
+// Everything that determines the contents of a gradient paint: the paint type, spread mode, the
+// gradient geometry (4 floats for linear, 5 for radial) followed by 5 floats per color stop.
+struct GradientKey {
+  VGPaintType type;
+  VGColorRampSpreadMode spread;
+  std::vector<VGfloat> params;
+
+  bool operator==(const GradientKey &other) const {
+    return type == other.type && spread == other.spread && params == other.params;
+  }
+};
+
+struct GradientKeyHash {
+  size_t operator()(const GradientKey &key) const {
+    // FNV-1a over the raw parameter bits
+    uint32_t h = 2166136261u ^ key.type ^ (key.spread << 16);
+    const auto bytes = reinterpret_cast<const uint8_t *>(key.params.data());
+    for (size_t i = 0; i < key.params.size() * sizeof(VGfloat); ++i) h = (h ^ bytes[i]) * 16777619u;
+    return h;
+  }
+};
+
+struct CachedGradient {
+  VGPaint paint;
+  bool opaque;
+  std::list<GradientKey>::iterator lruPos;
+};
+
+struct GradientCache {
+  size_t capacity = 32;
+  std::unordered_map<GradientKey, CachedGradient, GradientKeyHash> paints;
+  std::list<GradientKey> lru;
+  PaintCacheStats stats;
+
+  // Reused for lookups so a cache hit doesn't allocate
+  GradientKey scratchKey;
+  std::vector<GradientStop> scratchStops;
+};
+
+struct ColorTransform {
+  vec4 scale = vec4(1.0f);
+  vec4 bias = vec4(0.0f);
+  bool enabled = false;
+};
+
+// A saved subset of the render state. Fields that were not captured are left alone on pop.
+struct Style {
+  uint32_t flags;
+  Shadow<VGPaint> fillPaint, strokePaint;
+  bool fillOpaque, strokeOpaque;
+  bool fillSolid, strokeSolid;
+  uint32_t fillRGBA, strokeRGBA;
+  Shadow<Affine> fillPaintMatrix, strokePaintMatrix;
+  Shadow<VGfloat> strokeWidth;
+  Shadow<VGint> strokeCap, strokeJoin;
+  Shadow<VGint> fillRule;
+  ColorTransform colorTransform;
+  Shadow<bool> masking;
+  VGMaskOperation maskOperation;
+};
+
+struct CachedGeometry {
+  VGPath path;
+  // Counts the CPU-side copy of the source as well as the path
+  size_t bytes;
+  // What the path was built from, compared on lookup so a hash collision is a miss rather than the
+  // wrong geometry. `variant` holds anything else the path depends on, like the stroke style.
+  PathData source;
+  uint64_t variant;
+  std::list<uint64_t>::iterator lruPos;
+};
+
+// Retained geometry keyed by a hash: scratch path data for the geometry cache, stroke outlines for
+// the stroke cache. Geometry is only retained the second time it is drawn, so paths that change
+// every frame don't create a VGPath each time.
+struct GeometryCache {
+  bool enabled = false;
+  size_t budget = 1 << 20;
+  size_t bytes = 0;
+  std::unordered_map<uint64_t, CachedGeometry> paths;
+  std::list<uint64_t> lru;
+  std::unordered_set<uint64_t> seen;
+  // Keys whose geometry can't be retained, so it isn't rebuilt on every other draw
+  std::unordered_set<uint64_t> oversized;
+  GeometryCacheStats stats;
+};
+
+static const size_t MAX_SEEN_GEOMETRY = 1024;
+
+// Summaries are kept for the most recently drawn sample buffers, identified by address and length.
+struct CachedWaveform {
+  const float *samples;
+  size_t count;
+  WaveformSummary summary;
+  uint64_t lastUse;
+};
+
+static const size_t MAX_CACHED_WAVEFORMS = 8;
+
+static const size_t MAX_TRANSFORM_DEPTH = 64;
+
+// A scratch path made of a single circle, ellipse, rect or round rect. Instead of generating its
+// geometry it is drawn as a shared unit path under `placement`, and only written to the scratch
+// path data if more segments are added or the unit path can't be used.
+struct ScratchPrimitive {
+  enum Kind { NONE, ELLIPSE, RECT, ROUND_RECT };
+  Kind kind = NONE;
+  // Center and radii for ellipses, bounds and clamped corner radii for rects
+  float x, y, w, h, rx, ry;
+
+  Affine placement() const {
+    if (kind == ELLIPSE) return { rx, 0.0f, 0.0f, ry, x, y };
+    return { w, 0.0f, 0.0f, h, x, y };
+  }
+  // Stroke widths only survive the placement when it scales both axes equally
+  bool uniform() const { return kind == ELLIPSE ? rx == ry : w == h; }
+};
+
+// Unit square round rects keyed by their corner radii relative to the width and height.
+struct UnitRoundRect {
+  float rx, ry;
+  VGPath path;
+  uint64_t lastUse;
+};
+
+static const size_t MAX_UNIT_ROUND_RECTS = 8;
+static const size_t MAX_UNIT_ROUND_RECT_MISSES = 32;
+
+struct Bounds {
+  float minX, minY, maxX, maxY;
+
+  bool overlaps(const Bounds &o) const {
+    return minX < o.maxX && o.minX < maxX && minY < o.maxY && o.minY < maxY;
+  }
+};
+
+// Bounds the number of overlap tests a coalesced draw makes per shape
+static const size_t MAX_COALESCED_SHAPES = 128;
+
 struct Context {
+  // Scratch path geometry is collected on the CPU and appended to scratchPath with a single call
+  // when the path is drawn. Only segments added since the last draw are appended.
   VGPath scratchPath = 0;
-
-  std::vector<mat3> transformStack = { mat3() };
+  PathData scratchData;
+  size_t scratchUploadedSegments = 0;
+  size_t scratchUploadedCoords = 0;
+  bool scratchNeedsClear = false;
+  ScratchPrimitive scratchPrimitive;
+
+  VGPath unitCircle = VG_INVALID_HANDLE;
+  VGPath unitSquare = VG_INVALID_HANDLE;
+  std::vector<UnitRoundRect> unitRoundRects;
+  uint64_t unitRoundRectUses = 0;
+  // Radii that missed once, overwritten oldest first once full
+  std::vector<std::pair<float, float>> unitRoundRectMisses;
+  size_t nextUnitRoundRectMiss = 0;
+
+  // Holds the geometry of fillRects/fillCircles so they don't disturb the scratch path
+  VGPath batchPath = VG_INVALID_HANDLE;
+
+  // With coalescing enabled, scratch path draws that share state and don't overlap are collected
+  // here and drawn together. pendingModes is zero when nothing is pending.
+  bool coalesceDraws = false;
+  VGbitfield pendingModes = 0;
+  bool pendingToMask = false;
+  VGMaskOperation pendingMaskOperation;
+  PathData pendingData;
+  std::vector<Bounds> pendingBounds;
+  VGPath pendingPath = VG_INVALID_HANDLE;
+  Affine pendingTransform;
+
+  std::vector<CachedWaveform> waveforms;
+  uint64_t waveformUses = 0;
+  std::vector<float> waveformEnvelope;
+
+  // Reused by drawInstances so drawing doesn't allocate once they have grown
+  std::vector<Affine> instanceTransforms;
+  std::vector<uint32_t> instanceOrder;
+
+  // Used to build shapes appended to caller-owned VGPaths
+  PathData tempPathData;
+
+  RenderState state;
+  bool fillOpaque = false;
+  bool strokeOpaque = false;
+
+  // The solid colors last requested for fill and stroke, before any color transform is folded in.
+  bool fillSolid = false;
+  bool strokeSolid = false;
+  uint32_t fillRGBA = 0;
+  uint32_t strokeRGBA = 0;
+
+  // The color transform as seen by the user. It is only sent to OpenVG when a draw needs it.
+  ColorTransform colorTransform;
+  std::vector<ColorTransform> colorTransformStack;
+  bool foldColorTransform = false;
+  bool paintsFolded = false;
+  bool foldedPaintsDirty = false;
+
+  // The blend mode requested by the user. When it is SRC_OVER and a draw is known to be fully
+  // opaque we switch to SRC, which skips reading the destination.
+  VGBlendMode blendMode = VG_BLEND_SRC_OVER;
+  bool opaqueFastPath = true;
+
+  std::vector<Style> styleStack;
+
+  // Paints referenced from the style stack. Cache evictions of these are deferred until the last
+  // reference is released so a popped style never sets a destroyed paint.
+  std::unordered_map<VGPaint, int> paintRefs;
+  std::vector<VGPaint> orphanedPaints;
+  PaintCache paintCache;
+  GradientCache gradientCache;
+  GeometryCache geometryCache;
+  GeometryCache strokeCache;
+  // Stroke outlines are built here, since the stroked path may be tempPathData
+  PathData strokeOutline;
+  std::vector<Polyline> strokeLines;
+
+  // Fixed-capacity so pushTransform never allocates. transformStack[transformDepth] is the top.
+  Affine transformStack[MAX_TRANSFORM_DEPTH];
+  size_t transformDepth = 0;
+  // Pushes ignored because the stack was full, which their pops skip
+  size_t transformOverflow = 0;
+  bool transformDirty = true;
+  TransformStats transformStats;
   std::vector<Mask> maskStack;
 
   VGFont font = VG_INVALID_HANDLE;
@@ -41,12 +324,128 @@ struct Context {
 
   uint32_t textAlign = ALIGN_LEFT | ALIGN_BASELINE;
 
+  float svgTolerance = 1.0f / 64.0f;
+  // Coordinates of SVG shapes quantized to 8 or 16 bits for upload
+  std::vector<uint8_t> svgQuantizedCoords;
+
   bool drawingToMask = false;
   VGMaskOperation maskOperation = VG_UNION_MASK;
 };
 
 static Context ctx;
 
+static void flushPendingDraw();
+
+
+//
+// Render State
+//
+
+void invalidateRenderState() {
+  flushPendingDraw();
+  ctx.state = {};
+  ctx.transformDirty = true;
+}
+
+static void setPaint(const PaintInfo &info, VGbitfield paintModes) {
+  if (paintModes & VG_FILL_PATH) {
+    ctx.fillOpaque = info.opaque;
+    if (ctx.state.fillPaint.update(info.paint)) {
+      flushPendingDraw();
+      vgSetPaint(info.paint, VG_FILL_PATH);
+    }
+  }
+  if (paintModes & VG_STROKE_PATH) {
+    ctx.strokeOpaque = info.opaque;
+    if (ctx.state.strokePaint.update(info.paint)) {
+      flushPendingDraw();
+      vgSetPaint(info.paint, VG_STROKE_PATH);
+    }
+  }
+}
+
+// Called before a paint handle is destroyed so a later paint that reuses the handle value is not
+// mistaken for the one OpenVG still has set.
+static void forgetPaint(VGPaint paint) {
+  if (ctx.state.fillPaint.value == paint) ctx.state.fillPaint.valid = false;
+  if (ctx.state.strokePaint.value == paint) ctx.state.strokePaint.valid = false;
+}
+
+// Destroys a paint that has been dropped from a cache, unless a saved style still refers to it.
+static void destroyPaint(VGPaint paint) {
+  if (ctx.paintRefs.count(paint)) {
+    ctx.orphanedPaints.push_back(paint);
+    return;
+  }
+  flushPendingDraw();
+  forgetPaint(paint);
+  vgDestroyPaint(paint);
+}
+
+static void retainPaint(VGPaint paint) {
+  ++ctx.paintRefs[paint];
+}
+
+static void releasePaint(VGPaint paint) {
+  auto it = ctx.paintRefs.find(paint);
+  if (--it->second > 0) return;
+  ctx.paintRefs.erase(it);
+
+  auto orphan = std::find(ctx.orphanedPaints.begin(), ctx.orphanedPaints.end(), paint);
+  if (orphan != ctx.orphanedPaints.end()) {
+    ctx.orphanedPaints.erase(orphan);
+    destroyPaint(paint);
+  }
+}
+
+static void setMatrixMode(VGMatrixMode mode) {
+  if (ctx.state.matrixMode.update(mode)) vgSeti(VG_MATRIX_MODE, mode);
+}
+
+static void loadPathMatrix(const Affine &xf) {
+  setMatrixMode(VG_MATRIX_PATH_USER_TO_SURFACE);
+  if (ctx.state.pathMatrix.update(xf)) {
+    flushPendingDraw();
+    VGfloat m[9];
+    xf.toVGMatrix(m);
+    vgLoadMatrix(m);
+    ++ctx.transformStats.uploads;
+  }
+  else {
+    ++ctx.transformStats.uploadsAvoided;
+  }
+}
+
+// Uploads the current transform if it changed since the last draw. Transform operations only mark it
+// dirty, so a run of them costs a single vgLoadMatrix.
+static void flushTransform() {
+  if (!ctx.transformDirty) return;
+  ctx.transformDirty = false;
+  loadPathMatrix(ctx.transformStack[ctx.transformDepth]);
+}
+
+static void invalidateTransform() {
+  // A pending upload that gets superseded is one we no longer have to make
+  if (ctx.transformDirty) ++ctx.transformStats.uploadsAvoided;
+  ctx.transformDirty = true;
+}
+
+// Gradient geometry is given in paint space; this sets the paint-to-user matrix for the given modes.
+static void setPaintMatrix(const Affine &xf, VGbitfield paintModes) {
+  VGfloat m[9];
+  xf.toVGMatrix(m);
+  if (paintModes & VG_FILL_PATH && ctx.state.fillPaintMatrix.update(xf)) {
+    flushPendingDraw();
+    setMatrixMode(VG_MATRIX_FILL_PAINT_TO_USER);
+    vgLoadMatrix(m);
+  }
+  if (paintModes & VG_STROKE_PATH && ctx.state.strokePaintMatrix.update(xf)) {
+    flushPendingDraw();
+    setMatrixMode(VG_MATRIX_STROKE_PAINT_TO_USER);
+    vgLoadMatrix(m);
+  }
+}
+
 static void unpackRGBA(uint32_t color, float *r, float *g, float *b, float *a) {
   if (r) *r = (color         & 0xff) / 255.0f;
   if (g) *g = ((color >> 8)  & 0xff) / 255.0f;
@@ -61,6 +460,15 @@ static void unpackBGRA(uint32_t color, float *r, float *g, float *b, float *a) {
   if (a) *a = ((color >> 24) & 0xff) / 255.0f;
 }
 
+static uint8_t packChannel(float v) {
+  return static_cast<uint8_t>(clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static uint32_t packRGBA(float r, float g, float b, float a) {
+  return packChannel(r) | (packChannel(g) << 8) | (packChannel(b) << 16) |
+         (static_cast<uint32_t>(packChannel(a)) << 24);
+}
+
 vec3 colorBGR(uint32_t color) {
   vec3 c;
   unpackBGRA(color, &c.r, &c.g, &c.b, nullptr);
@@ -105,64 +513,425 @@ static VGPaint createPaintFromRGBA(float r, float g, float b, float a) {
   return paint;
 }
 
-static VGPaint createPaintFromNSVGpaint(const NSVGpaint &svgPaint, float opacity = 1.0f) {
-  auto paint = vgCreatePaint();
+//
+// Paint Cache
+//
 
-  if (svgPaint.type == NSVG_PAINT_COLOR) {
-    VGfloat color[4];
-    unpackRGBA(svgPaint.color, &color[0], &color[1], &color[2], nullptr);
-    color[3] = opacity;
-    vgSetParameteri(paint, VG_PAINT_TYPE, VG_PAINT_TYPE_COLOR);
-    vgSetParameterfv(paint, VG_PAINT_COLOR, 4, color);
-  }
-
-  // TODO(ryan): We don't need gradients yet, but I got about halfway through
-  // implementing them. Finish this up when we actually need them.
-
-  // else if (svgPaint.type == NSVG_PAINT_LINEAR_GRADIENT ||
-  //          svgPaint.type == NSVG_PAINT_RADIAL_GRADIENT) {
-  //   const auto &grad = *svgPaint.gradient;
-
-  //   if (svgPaint.type == NSVG_PAINT_LINEAR_GRADIENT) {
-  //     VGfloat points[] = {};
-  //     vgSetParameteri(paint, VG_PAINT_TYPE, VG_PAINT_TYPE_LINEAR_GRADIENT);
-  //     vgSetParameterfv(paint, VG_PAINT_LINEAR_GRADIENT, 4, points);
-  //   }
-
-  //   VGfloat stops[5 * grad.nstops];
-  //   for (int i = 0; i < grad.nstops; ++i) {
-  //     auto s = &stops[i * 5];
-  //     s[0] = grad.stops[i].offset;
-  //     unpackRGB(grad.stops[i].color, s[1], s[2], s[3]);
-  //     s[4] = 1.0f; // TODO(ryan): Are NSVG gradients always opaque?
-  //   }
-
-  //   vgSetParameteri(paint, VG_PAINT_COLOR_RAMP_SPREAD_MODE,
-  //                   fromNSVG(static_cast<NSVGspreadType>(grad.spread)));
-  //   vgSetParameteri(paint, VG_PAINT_COLOR_RAMP_PREMULTIPLIED, false);
-  //   vgSetParameterfv(paint, VG_PAINT_COLOR_RAMP_STOPS, 5 * grad.nstops, stops);
-  // }
+static void evictPaint() {
+  auto &cache = ctx.paintCache;
+  auto it = cache.paints.find(cache.lru.back());
+  // Paints that are still set on the context stay alive inside OpenVG until they are replaced.
+  destroyPaint(it->second.paint);
+  cache.paints.erase(it);
+  cache.lru.pop_back();
+  ++cache.stats.evictions;
+}
+
+// Returns a live paint for the packed RGBA color, creating it on a miss. The returned paint is owned
+// by the cache and must not be destroyed by the caller.
+static PaintInfo getColorPaint(uint32_t rgba) {
+  auto &cache = ctx.paintCache;
+  bool opaque = (rgba >> 24) == 0xff;
+
+  auto it = cache.paints.find(rgba);
+  if (it != cache.paints.end()) {
+    cache.lru.splice(cache.lru.begin(), cache.lru, it->second.lruPos);
+    ++cache.stats.hits;
+    return { it->second.paint, opaque };
+  }
+
+  ++cache.stats.misses;
+
+  float r, g, b, a;
+  unpackRGBA(rgba, &r, &g, &b, &a);
+  auto paint = createPaintFromRGBA(r, g, b, a);
+  while (cache.paints.size() >= cache.capacity) evictPaint();
+
+  cache.lru.push_front(rgba);
+  cache.paints[rgba] = { paint, cache.lru.begin() };
+  return { paint, opaque };
+}
+
+
+//
+// Color Transform
+//
+
+static bool isColorTransformActive() {
+  const auto &xf = ctx.colorTransform;
+  return xf.enabled && (xf.scale != vec4(1.0f) || xf.bias != vec4(0.0f));
+}
+
+static uint32_t applyColorTransform(uint32_t rgba) {
+  const auto &xf = ctx.colorTransform;
+  vec4 c;
+  unpackRGBA(rgba, &c.r, &c.g, &c.b, &c.a);
+  c = c * xf.scale + xf.bias;
+  return packRGBA(c.r, c.g, c.b, c.a);
+}
+
+static void bindSolidPaints(bool folded) {
+  if (ctx.fillSolid) {
+    setPaint(getColorPaint(folded ? applyColorTransform(ctx.fillRGBA) : ctx.fillRGBA),
+             VG_FILL_PATH);
+  }
+  if (ctx.strokeSolid) {
+    setPaint(getColorPaint(folded ? applyColorTransform(ctx.strokeRGBA) : ctx.strokeRGBA),
+             VG_STROKE_PATH);
+  }
+}
+
+static void setSolidPaint(uint32_t rgba, VGbitfield paintModes) {
+  if (paintModes & VG_FILL_PATH) {
+    ctx.fillSolid = true;
+    ctx.fillRGBA = rgba;
+  }
+  if (paintModes & VG_STROKE_PATH) {
+    ctx.strokeSolid = true;
+    ctx.strokeRGBA = rgba;
+  }
+  setPaint(getColorPaint(ctx.paintsFolded ? applyColorTransform(rgba) : rgba), paintModes);
+}
+
+static void setNonSolidPaint(const PaintInfo &info, VGbitfield paintModes) {
+  if (paintModes & VG_FILL_PATH) ctx.fillSolid = false;
+  if (paintModes & VG_STROKE_PATH) ctx.strokeSolid = false;
+  setPaint(info, paintModes);
+}
+
+// Brings OpenVG's color transform in line with the CPU-side one before drawing with the given paint
+// modes. With folding enabled, solid paints have the transform baked into their color and OpenVG's
+// color transform stage stays off unless a gradient is being drawn.
+static void syncColorTransform(VGbitfield paintModes) {
+  bool active = isColorTransformActive();
+  bool drawsGradient = (paintModes & VG_FILL_PATH && !ctx.fillSolid) ||
+                       (paintModes & VG_STROKE_PATH && !ctx.strokeSolid);
+  bool fold = active && ctx.foldColorTransform && !drawsGradient;
+
+  if (fold != ctx.paintsFolded || (fold && ctx.foldedPaintsDirty)) {
+    bindSolidPaints(fold);
+    ctx.paintsFolded = fold;
+  }
+  ctx.foldedPaintsDirty = false;
+
+  bool useVG = active && !fold;
+  if (useVG) {
+    const auto &xf = ctx.colorTransform;
+    if (ctx.state.colorTransform.update({ xf.scale, xf.bias })) {
+      flushPendingDraw();
+      VGfloat values[] = { xf.scale.r, xf.scale.g, xf.scale.b, xf.scale.a,
+                           xf.bias.r,  xf.bias.g,  xf.bias.b,  xf.bias.a };
+      vgSetfv(VG_COLOR_TRANSFORM_VALUES, 8, values);
+    }
+  }
+  if (ctx.state.colorTransformEnabled.update(useVG)) {
+    flushPendingDraw();
+    vgSeti(VG_COLOR_TRANSFORM, useVG ? VG_TRUE : VG_FALSE);
+  }
+}
+
+void setColorTransform(float sr, float sg, float sb, float sa,
+                       float br, float bg, float bb, float ba) {
+  ctx.colorTransform.scale = vec4(sr, sg, sb, sa);
+  ctx.colorTransform.bias = vec4(br, bg, bb, ba);
+  ctx.foldedPaintsDirty = true;
+}
+
+void setColorTransform(const vec4 &scale, const vec4 &bias) {
+  setColorTransform(scale.r, scale.g, scale.b, scale.a, bias.r, bias.g, bias.b, bias.a);
+}
+
+const std::pair<vec4, vec4> getColorTransform() {
+  return { ctx.colorTransform.scale, ctx.colorTransform.bias };
+}
+
+void enableColorTransform() {
+  ctx.colorTransform.enabled = true;
+  ctx.foldedPaintsDirty = true;
+}
+void disableColorTransform() {
+  ctx.colorTransform.enabled = false;
+  ctx.foldedPaintsDirty = true;
+}
+
+bool getColorTransformEnabled() {
+  return ctx.colorTransform.enabled;
+}
+
+// Applies the new transform to colors first and the current one to the result, so nested fades
+// multiply.
+void pushColorTransform(const vec4 &scale, const vec4 &bias) {
+  auto &xf = ctx.colorTransform;
+  ctx.colorTransformStack.push_back(xf);
+  if (xf.enabled) {
+    xf.bias = bias * xf.scale + xf.bias;
+    xf.scale = scale * xf.scale;
+  }
+  else {
+    xf.scale = scale;
+    xf.bias = bias;
+    xf.enabled = true;
+  }
+  ctx.foldedPaintsDirty = true;
+}
+
+void popColorTransform() {
+  ctx.colorTransform = ctx.colorTransformStack.back();
+  ctx.colorTransformStack.pop_back();
+  ctx.foldedPaintsDirty = true;
+}
+
+void enableColorTransformFolding() {
+  ctx.foldColorTransform = true;
+}
+void disableColorTransformFolding() {
+  ctx.foldColorTransform = false;
+}
 
+
+void setPaintCacheCapacity(size_t capacity) {
+  auto &cache = ctx.paintCache;
+  // The most recently returned paint must stay alive until the caller has set it.
+  cache.capacity = std::max<size_t>(capacity, 1);
+  while (cache.paints.size() > cache.capacity) evictPaint();
+}
+
+void clearPaintCache() {
+  auto &cache = ctx.paintCache;
+  for (auto &entry : cache.paints) {
+    destroyPaint(entry.second.paint);
+  }
+  cache.paints.clear();
+  cache.lru.clear();
+}
+
+PaintCacheStats getPaintCacheStats() {
+  auto stats = ctx.paintCache.stats;
+  stats.size = ctx.paintCache.paints.size();
+  stats.capacity = ctx.paintCache.capacity;
+  return stats;
+}
+
+void resetPaintCacheStats() {
+  ctx.paintCache.stats = {};
+}
+
+
+//
+// Gradients
+//
+
+static VGPaint createGradientPaint(const GradientKey &key) {
+  auto paint = vgCreatePaint();
+  auto geometrySize = key.type == VG_PAINT_TYPE_LINEAR_GRADIENT ? 4 : 5;
+  auto numStopParams = static_cast<VGint>(key.params.size()) - geometrySize;
+
+  vgSetParameteri(paint, VG_PAINT_TYPE, key.type);
+  vgSetParameterfv(paint, key.type == VG_PAINT_TYPE_LINEAR_GRADIENT ? VG_PAINT_LINEAR_GRADIENT
+                                                                     : VG_PAINT_RADIAL_GRADIENT,
+                   geometrySize, key.params.data());
+  vgSetParameteri(paint, VG_PAINT_COLOR_RAMP_SPREAD_MODE, key.spread);
+  vgSetParameteri(paint, VG_PAINT_COLOR_RAMP_PREMULTIPLIED, VG_FALSE);
+  vgSetParameterfv(paint, VG_PAINT_COLOR_RAMP_STOPS, numStopParams,
+                   key.params.data() + geometrySize);
   return paint;
 }
 
+static void evictGradient() {
+  auto &cache = ctx.gradientCache;
+  auto it = cache.paints.find(cache.lru.back());
+  destroyPaint(it->second.paint);
+  cache.paints.erase(it);
+  cache.lru.pop_back();
+  ++cache.stats.evictions;
+}
+
+// Fills in `key` for the given geometry and stops. Returns whether every stop is opaque.
+static bool buildGradientKey(VGPaintType type, const VGfloat *geometry, const GradientStop *stops,
+                             size_t numStops, VGColorRampSpreadMode spread, GradientKey &key) {
+  key.type = type;
+  key.spread = spread;
+  key.params.assign(geometry, geometry + (type == VG_PAINT_TYPE_LINEAR_GRADIENT ? 4 : 5));
+  bool opaque = true;
+  for (size_t i = 0; i < numStops; ++i) {
+    const auto &stop = stops[i];
+    opaque = opaque && stop.color.a >= 1.0f;
+    VGfloat s[] = { stop.offset, stop.color.r, stop.color.g, stop.color.b, stop.color.a };
+    key.params.insert(key.params.end(), s, s + 5);
+  }
+  return opaque;
+}
+
+// Returns a live gradient paint for `key`, building the color ramp only on a cache miss. The
+// returned paint is owned by the cache.
+static PaintInfo getGradientPaint(const GradientKey &key, bool opaque) {
+  auto &cache = ctx.gradientCache;
+
+  auto it = cache.paints.find(key);
+  if (it != cache.paints.end()) {
+    cache.lru.splice(cache.lru.begin(), cache.lru, it->second.lruPos);
+    ++cache.stats.hits;
+    return { it->second.paint, it->second.opaque };
+  }
+
+  ++cache.stats.misses;
+
+  auto paint = createGradientPaint(key);
+  while (cache.paints.size() >= cache.capacity) evictGradient();
+
+  cache.lru.push_front(key);
+  cache.paints[key] = { paint, opaque, cache.lru.begin() };
+  return { paint, opaque };
+}
+
+static PaintInfo getGradientPaint(VGPaintType type, const VGfloat *geometry,
+                                const GradientStop *stops, size_t numStops,
+                                VGColorRampSpreadMode spread) {
+  auto &key = ctx.gradientCache.scratchKey;
+  bool opaque = buildGradientKey(type, geometry, stops, numStops, spread, key);
+  return getGradientPaint(key, opaque);
+}
+
+static void linearGradient(const vec2 &start, const vec2 &end, const GradientStop *stops,
+                           size_t numStops, VGColorRampSpreadMode spread, VGbitfield paintModes) {
+  VGfloat geometry[] = { start.x, start.y, end.x, end.y };
+  setPaintMatrix(Affine(), paintModes);
+  setNonSolidPaint(
+    getGradientPaint(VG_PAINT_TYPE_LINEAR_GRADIENT, geometry, stops, numStops, spread), paintModes);
+}
+
+static void radialGradient(const vec2 &center, const vec2 &focus, float radius,
+                           const GradientStop *stops, size_t numStops,
+                           VGColorRampSpreadMode spread, VGbitfield paintModes) {
+  VGfloat geometry[] = { center.x, center.y, focus.x, focus.y, radius };
+  setPaintMatrix(Affine(), paintModes);
+  setNonSolidPaint(
+    getGradientPaint(VG_PAINT_TYPE_RADIAL_GRADIENT, geometry, stops, numStops, spread), paintModes);
+}
+
+void fillLinearGradient(const vec2 &start, const vec2 &end, const GradientStop *stops,
+                        size_t numStops, VGColorRampSpreadMode spread) {
+  linearGradient(start, end, stops, numStops, spread, VG_FILL_PATH);
+}
+
+void fillRadialGradient(const vec2 &center, const vec2 &focus, float radius,
+                        const GradientStop *stops, size_t numStops, VGColorRampSpreadMode spread) {
+  radialGradient(center, focus, radius, stops, numStops, spread, VG_FILL_PATH);
+}
+void fillRadialGradient(const vec2 &center, float radius, const GradientStop *stops,
+                        size_t numStops, VGColorRampSpreadMode spread) {
+  radialGradient(center, center, radius, stops, numStops, spread, VG_FILL_PATH);
+}
+
+void strokeLinearGradient(const vec2 &start, const vec2 &end, const GradientStop *stops,
+                          size_t numStops, VGColorRampSpreadMode spread) {
+  linearGradient(start, end, stops, numStops, spread, VG_STROKE_PATH);
+}
+
+void strokeRadialGradient(const vec2 &center, const vec2 &focus, float radius,
+                          const GradientStop *stops, size_t numStops,
+                          VGColorRampSpreadMode spread) {
+  radialGradient(center, focus, radius, stops, numStops, spread, VG_STROKE_PATH);
+}
+void strokeRadialGradient(const vec2 &center, float radius, const GradientStop *stops,
+                          size_t numStops, VGColorRampSpreadMode spread) {
+  radialGradient(center, center, radius, stops, numStops, spread, VG_STROKE_PATH);
+}
+
+void setGradientCacheCapacity(size_t capacity) {
+  auto &cache = ctx.gradientCache;
+  cache.capacity = std::max<size_t>(capacity, 1);
+  while (cache.paints.size() > cache.capacity) evictGradient();
+}
+
+void clearGradientCache() {
+  auto &cache = ctx.gradientCache;
+  for (auto &entry : cache.paints) {
+    destroyPaint(entry.second.paint);
+  }
+  cache.paints.clear();
+  cache.lru.clear();
+}
+
+PaintCacheStats getGradientCacheStats() {
+  auto stats = ctx.gradientCache.stats;
+  stats.size = ctx.gradientCache.paints.size();
+  stats.capacity = ctx.gradientCache.capacity;
+  return stats;
+}
+
+void resetGradientCacheStats() {
+  ctx.gradientCache.stats = {};
+}
+
+
+// NanoSVG stores gradients in a unit space (a linear gradient runs from (0, 0) to (0, 1), a radial
+// gradient is the unit circle) along with the user-to-gradient transform. We use the unit paint
+// with the inverse of that transform as the paint-to-user matrix, which this returns after filling
+// in the key of the unit paint.
+static Affine getNSVGgradientKey(const NSVGpaint &svgPaint, float opacity, GradientKey &key,
+                                 bool &opaque) {
+  const auto &grad = *svgPaint.gradient;
+
+  auto &stops = ctx.gradientCache.scratchStops;
+  stops.resize(grad.nstops);
+  for (int i = 0; i < grad.nstops; ++i) {
+    stops[i].offset = grad.stops[i].offset;
+    unpackRGBA(grad.stops[i].color, &stops[i].color.r, &stops[i].color.g, &stops[i].color.b,
+               &stops[i].color.a);
+    stops[i].color.a *= opacity;
+  }
+
+  auto spread = fromNSVG(static_cast<NSVGspreadType>(grad.spread));
+  if (svgPaint.type == NSVG_PAINT_LINEAR_GRADIENT) {
+    VGfloat geometry[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    opaque = buildGradientKey(VG_PAINT_TYPE_LINEAR_GRADIENT, geometry, stops.data(), stops.size(),
+                              spread, key);
+  }
+  else {
+    // NanoSVG's own rasterizer ignores the focal point, so we do too.
+    VGfloat geometry[] = { 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    opaque = buildGradientKey(VG_PAINT_TYPE_RADIAL_GRADIENT, geometry, stops.data(), stops.size(),
+                              spread, key);
+  }
+
+  const auto t = grad.xform;
+  return invert(Affine(t[0], t[1], t[2], t[3], t[4], t[5]));
+}
+
+static void setNSVGgradient(const NSVGpaint &svgPaint, float opacity, VGbitfield paintModes) {
+  auto &key = ctx.gradientCache.scratchKey;
+  bool opaque;
+  setPaintMatrix(getNSVGgradientKey(svgPaint, opacity, key, opaque), paintModes);
+  setNonSolidPaint(getGradientPaint(key, opaque), paintModes);
+}
+
+// NanoSVG packs colors like packRGBA; the alpha comes from the shape opacity instead
+static uint32_t getNSVGcolor(const NSVGpaint &svgPaint, float opacity) {
+  return (svgPaint.color & 0xffffff) | (static_cast<uint32_t>(packChannel(opacity)) << 24);
+}
+
+static void setNSVGpaint(const NSVGpaint &svgPaint, float opacity, VGPaintMode paintMode) {
+  if (svgPaint.type == NSVG_PAINT_COLOR) {
+    setSolidPaint(getNSVGcolor(svgPaint, opacity), paintMode);
+  }
+  else if (svgPaint.type == NSVG_PAINT_LINEAR_GRADIENT ||
+           svgPaint.type == NSVG_PAINT_RADIAL_GRADIENT) {
+    setNSVGgradient(svgPaint, opacity, paintMode);
+  }
+}
+
 
 void strokePaint(const NSVGpaint &svgPaint, float opacity) {
-  auto paint = createPaintFromNSVGpaint(svgPaint, opacity);
-  vgSetPaint(paint, VG_STROKE_PATH);
-  vgDestroyPaint(paint);
+  setNSVGpaint(svgPaint, opacity, VG_STROKE_PATH);
 }
 
 void fillPaint(const NSVGpaint &svgPaint, float opacity) {
-  auto paint = createPaintFromNSVGpaint(svgPaint, opacity);
-  vgSetPaint(paint, VG_FILL_PATH);
-  vgDestroyPaint(paint);
+  setNSVGpaint(svgPaint, opacity, VG_FILL_PATH);
 }
 
 void strokeColor(float r, float g, float b, float a) {
-  auto paint = createPaintFromRGBA(r, g, b, a);
-  vgSetPaint(paint, VG_STROKE_PATH);
-  vgDestroyPaint(paint);
+  setSolidPaint(packRGBA(r, g, b, a), VG_STROKE_PATH);
 }
 void strokeColor(const vec4 &color) {
   strokeColor(color.r, color.g, color.b, color.a);
@@ -171,15 +940,11 @@ void strokeColor(const vec3 &color) {
   strokeColor(color.r, color.g, color.b);
 }
 void strokeColor(uint32_t color) {
-  float r, g, b, a;
-  unpackRGBA(color, &r, &g, &b, &a);
-  strokeColor(r, g, b, a);
+  setSolidPaint(color, VG_STROKE_PATH);
 }
 
 void fillColor(float r, float g, float b, float a) {
-  auto paint = createPaintFromRGBA(r, g, b, a);
-  vgSetPaint(paint, VG_FILL_PATH);
-  vgDestroyPaint(paint);
+  setSolidPaint(packRGBA(r, g, b, a), VG_FILL_PATH);
 }
 void fillColor(const vec4 &color) {
   fillColor(color.r, color.g, color.b, color.a);
@@ -188,21 +953,43 @@ void fillColor(const vec3 &color) {
   fillColor(color.r, color.g, color.b);
 }
 void fillColor(uint32_t color) {
-  float r, g, b, a;
-  unpackRGBA(color, &r, &g, &b, &a);
-  fillColor(r, g, b, a);
+  setSolidPaint(color, VG_FILL_PATH);
 }
 
 void strokeWidth(VGfloat width) {
-  vgSetf(VG_STROKE_LINE_WIDTH, width);
+  if (ctx.state.strokeWidth.update(width)) {
+    flushPendingDraw();
+    vgSetf(VG_STROKE_LINE_WIDTH, width);
+  }
 }
 
 void strokeCap(VGCapStyle cap) {
-  vgSeti(VG_STROKE_CAP_STYLE, cap);
+  if (ctx.state.strokeCap.update(cap)) {
+    flushPendingDraw();
+    vgSeti(VG_STROKE_CAP_STYLE, cap);
+  }
 }
 
 void strokeJoin(VGJoinStyle join) {
-  vgSeti(VG_STROKE_JOIN_STYLE, join);
+  if (ctx.state.strokeJoin.update(join)) {
+    flushPendingDraw();
+    vgSeti(VG_STROKE_JOIN_STYLE, join);
+  }
+}
+
+VGfloat getStrokeWidth() {
+  if (!ctx.state.strokeWidth.valid) ctx.state.strokeWidth.update(vgGetf(VG_STROKE_LINE_WIDTH));
+  return ctx.state.strokeWidth.value;
+}
+
+VGCapStyle getStrokeCap() {
+  if (!ctx.state.strokeCap.valid) ctx.state.strokeCap.update(vgGeti(VG_STROKE_CAP_STYLE));
+  return static_cast<VGCapStyle>(ctx.state.strokeCap.value);
+}
+
+VGJoinStyle getStrokeJoin() {
+  if (!ctx.state.strokeJoin.valid) ctx.state.strokeJoin.update(vgGeti(VG_STROKE_JOIN_STYLE));
+  return static_cast<VGJoinStyle>(ctx.state.strokeJoin.value);
 }
 
 
@@ -212,156 +999,1735 @@ void moveTo(VGPath path, float x, float y) {
   vgAppendPathData(path, 1, segs, coords);
 }
 
-void lineTo(VGPath path, float x, float y) {
-  VGubyte segs[] = { VG_LINE_TO };
-  VGfloat coords[] = { x, y };
-  vgAppendPathData(path, 1, segs, coords);
+void lineTo(VGPath path, float x, float y) {
+  VGubyte segs[] = { VG_LINE_TO };
+  VGfloat coords[] = { x, y };
+  vgAppendPathData(path, 1, segs, coords);
+}
+
+void cubicTo(VGPath path, float x1, float y1, float x2, float y2, float x3, float y3) {
+  VGubyte segs[] = { VG_CUBIC_TO };
+  VGfloat coords[] = { x1, y1, x2, y2, x3, y3 };
+  vgAppendPathData(path, 1, segs, coords);
+}
+
+static PathData &beginTempPathData() {
+  ctx.tempPathData.clear();
+  return ctx.tempPathData;
+}
+
+void arc(VGPath path, float x, float y, float w, float h, float startAngle, float endAngle) {
+  auto &data = beginTempPathData();
+  data.arc(x, y, w, h, startAngle, endAngle);
+  data.appendTo(path);
+}
+
+void circle(VGPath path, float x, float y, float radius) {
+  auto &data = beginTempPathData();
+  data.ellipse(x, y, radius, radius);
+  data.appendTo(path);
+}
+
+void ellipse(VGPath path, float x, float y, float rx, float ry) {
+  auto &data = beginTempPathData();
+  data.ellipse(x, y, rx, ry);
+  data.appendTo(path);
+}
+
+void rect(VGPath path, float x, float y, float width, float height) {
+  auto &data = beginTempPathData();
+  data.rect(x, y, width, height);
+  data.appendTo(path);
+}
+
+void roundRect(VGPath path, float x, float y, float width, float height, float radius) {
+  auto &data = beginTempPathData();
+  data.roundRect(x, y, width, height, radius);
+  data.appendTo(path);
+}
+
+void polyline(VGPath path, const vec2 *pts, size_t count) {
+  auto &data = beginTempPathData();
+  data.polyline(pts, count);
+  data.appendTo(path);
+}
+
+void polyline(VGPath path, const float *samples, size_t count, size_t stride, float x, float dx,
+              float y, float yScale) {
+  auto &data = beginTempPathData();
+  data.polyline(samples, count, stride, x, dx, y, yScale);
+  data.appendTo(path);
+}
+
+void polygon(VGPath path, const vec2 *pts, size_t count) {
+  auto &data = beginTempPathData();
+  data.polyline(pts, count, true);
+  data.appendTo(path);
+}
+
+
+//
+// Scratch Path Operators
+//
+
+void beginPath() {
+  ctx.scratchData.clear();
+  ctx.scratchPrimitive.kind = ScratchPrimitive::NONE;
+  if (ctx.scratchUploadedSegments > 0) {
+    ctx.scratchNeedsClear = true;
+    ctx.scratchUploadedSegments = ctx.scratchUploadedCoords = 0;
+  }
+}
+
+// Returns the scratch path data, first writing out a pending primitive.
+static PathData &scratchData() {
+  auto &prim = ctx.scratchPrimitive;
+  switch (prim.kind) {
+    case ScratchPrimitive::NONE: break;
+    case ScratchPrimitive::ELLIPSE: ctx.scratchData.ellipse(prim.x, prim.y, prim.rx, prim.ry); break;
+    case ScratchPrimitive::RECT: ctx.scratchData.rect(prim.x, prim.y, prim.w, prim.h); break;
+    case ScratchPrimitive::ROUND_RECT:
+      ctx.scratchData.roundRect(prim.x, prim.y, prim.w, prim.h, prim.rx, prim.ry);
+      break;
+  }
+  prim.kind = ScratchPrimitive::NONE;
+  return ctx.scratchData;
+}
+
+// Starts a primitive on an empty scratch path, or returns false if there is already geometry.
+static bool beginScratchPrimitive(ScratchPrimitive::Kind kind) {
+  if (!ctx.scratchData.empty() || ctx.scratchPrimitive.kind != ScratchPrimitive::NONE) return false;
+  ctx.scratchPrimitive.kind = kind;
+  return true;
+}
+
+// Appends the segments added since the last draw and returns the scratch path ready for drawing.
+static VGPath flushScratchPath() {
+  auto &data = scratchData();
+
+  if (ctx.scratchPath == VG_INVALID_HANDLE) {
+    ctx.scratchPath = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f, 0, 0,
+                                   VG_PATH_CAPABILITY_APPEND_TO);
+  }
+  else if (ctx.scratchNeedsClear) {
+    vgClearPath(ctx.scratchPath, VG_PATH_CAPABILITY_APPEND_TO);
+  }
+  ctx.scratchNeedsClear = false;
+
+  data.appendTo(ctx.scratchPath, ctx.scratchUploadedSegments, ctx.scratchUploadedCoords);
+  ctx.scratchUploadedSegments = data.segments.size();
+  ctx.scratchUploadedCoords = data.coords.size();
+  return ctx.scratchPath;
+}
+
+static void removeGeometry(GeometryCache &cache,
+                           std::unordered_map<uint64_t, CachedGeometry>::iterator it) {
+  vgDestroyPath(it->second.path);
+  cache.bytes -= it->second.bytes;
+  cache.lru.erase(it->second.lruPos);
+  cache.paths.erase(it);
+}
+
+static void evictGeometry(GeometryCache &cache) {
+  removeGeometry(cache, cache.paths.find(cache.lru.back()));
+  ++cache.stats.evictions;
+}
+
+// Returns the path retained under `key` if it was built from `source` and `variant`, or
+// VG_INVALID_HANDLE on a miss.
+static VGPath findGeometry(GeometryCache &cache, uint64_t key, const PathData &source,
+                           uint64_t variant) {
+  auto it = cache.paths.find(key);
+  if (it == cache.paths.end() || it->second.variant != variant ||
+      it->second.source.segments != source.segments ||
+      it->second.source.coords != source.coords) {
+    ++cache.stats.misses;
+    return VG_INVALID_HANDLE;
+  }
+  cache.lru.splice(cache.lru.begin(), cache.lru, it->second.lruPos);
+  ++cache.stats.hits;
+  return it->second.path;
+}
+
+// Called after a miss; returns true if this is the second time `key` was missed.
+static bool isRepeatMiss(GeometryCache &cache, uint64_t key) {
+  if (cache.seen.insert(key).second) {
+    // Forget everything once the set is full rather than tracking the age of each entry
+    if (cache.seen.size() > MAX_SEEN_GEOMETRY) {
+      cache.seen.clear();
+      cache.seen.insert(key);
+    }
+    return false;
+  }
+  cache.seen.erase(key);
+  return true;
+}
+
+// Called after a miss; returns true if this is the second time `key` was missed and the geometry,
+// of roughly `bytes`, fits the budget.
+static bool shouldRetainGeometry(GeometryCache &cache, uint64_t key, size_t bytes) {
+  if (bytes > cache.budget) return false;
+  return isRepeatMiss(cache, key);
+}
+
+// Remembers that the geometry for `key` doesn't fit the budget.
+static void rejectGeometry(GeometryCache &cache, uint64_t key) {
+  if (cache.oversized.size() >= MAX_SEEN_GEOMETRY) cache.oversized.clear();
+  cache.oversized.insert(key);
+}
+
+// Takes ownership of `path`, evicting the least recently used paths to make room. `bytes` must
+// include the copy of `source`. A colliding entry under the same key is replaced.
+static void retainGeometry(GeometryCache &cache, uint64_t key, const PathData &source,
+                           uint64_t variant, VGPath path, size_t bytes) {
+  auto existing = cache.paths.find(key);
+  if (existing != cache.paths.end()) removeGeometry(cache, existing);
+  while (cache.bytes + bytes > cache.budget && !cache.lru.empty()) evictGeometry(cache);
+  cache.lru.push_front(key);
+  cache.paths[key] = { path, bytes, source, variant, cache.lru.begin() };
+  cache.bytes += bytes;
+}
+
+static void clearGeometry(GeometryCache &cache) {
+  for (auto &entry : cache.paths) {
+    vgDestroyPath(entry.second.path);
+  }
+  cache.paths.clear();
+  cache.lru.clear();
+  cache.seen.clear();
+  cache.oversized.clear();
+  cache.bytes = 0;
+}
+
+static GeometryCacheStats getGeometryStats(const GeometryCache &cache) {
+  auto stats = cache.stats;
+  stats.size = cache.paths.size();
+  stats.bytes = cache.bytes;
+  stats.budget = cache.budget;
+  return stats;
+}
+
+static size_t getPathDataBytes(const PathData &data) {
+  return data.segments.size() + data.coords.size() * sizeof(VGfloat);
+}
+
+// Returns the retained path for `data` if it was drawn before, or VG_INVALID_HANDLE if it should
+// go through the scratch path this time.
+static VGPath getCachedGeometry(const PathData &data) {
+  auto &cache = ctx.geometryCache;
+  auto key = data.hash();
+
+  auto path = findGeometry(cache, key, data, 0);
+  if (path != VG_INVALID_HANDLE) return path;
+
+  // The path and the copy of the data kept to check hits against
+  size_t bytes = getPathDataBytes(data) * 2;
+  if (!shouldRetainGeometry(cache, key, bytes)) return VG_INVALID_HANDLE;
+  path = data.createPath(0);
+  retainGeometry(cache, key, data, 0, path, bytes);
+  return path;
+}
+
+void enableGeometryCache() {
+  ctx.geometryCache.enabled = true;
+}
+void disableGeometryCache() {
+  clearGeometryCache();
+  ctx.geometryCache.enabled = false;
+}
+
+void setGeometryCacheBudget(size_t bytes) {
+  auto &cache = ctx.geometryCache;
+  cache.budget = bytes;
+  while (cache.bytes > cache.budget) evictGeometry(cache);
+}
+
+void clearGeometryCache() {
+  clearGeometry(ctx.geometryCache);
+}
+
+GeometryCacheStats getGeometryCacheStats() {
+  return getGeometryStats(ctx.geometryCache);
+}
+
+void resetGeometryCacheStats() {
+  ctx.geometryCache.stats = {};
+}
+
+static VGPath createUnitPath(const PathData &data) {
+  return data.createPath(0);
+}
+
+static VGPath getUnitRoundRect(float rx, float ry) {
+  auto &paths = ctx.unitRoundRects;
+  ++ctx.unitRoundRectUses;
+  for (auto &entry : paths) {
+    if (entry.rx == rx && entry.ry == ry) {
+      entry.lastUse = ctx.unitRoundRectUses;
+      return entry.path;
+    }
+  }
+
+  // Round rects whose size changes with the same corner radius get new radii every time, and
+  // creating a unit path for each would cost more than the scratch path. Radii are only given a
+  // unit path once they miss a second time; until then the round rect is drawn from the scratch
+  // path.
+  auto &misses = ctx.unitRoundRectMisses;
+  auto miss = std::find(misses.begin(), misses.end(), std::make_pair(rx, ry));
+  if (miss == misses.end()) {
+    if (misses.size() < MAX_UNIT_ROUND_RECT_MISSES) {
+      misses.emplace_back(rx, ry);
+    }
+    else {
+      misses[ctx.nextUnitRoundRectMiss] = { rx, ry };
+      ctx.nextUnitRoundRectMiss = (ctx.nextUnitRoundRectMiss + 1) % MAX_UNIT_ROUND_RECT_MISSES;
+    }
+    return VG_INVALID_HANDLE;
+  }
+  misses.erase(miss);
+
+  if (paths.size() >= MAX_UNIT_ROUND_RECTS) {
+    auto lru = std::min_element(paths.begin(), paths.end(),
+                                [](const UnitRoundRect &l, const UnitRoundRect &r) {
+                                  return l.lastUse < r.lastUse;
+                                });
+    vgDestroyPath(lru->path);
+    paths.erase(lru);
+  }
+
+  auto &data = beginTempPathData();
+  data.roundRect(0.0f, 0.0f, 1.0f, 1.0f, rx, ry);
+  paths.push_back({ rx, ry, createUnitPath(data), ctx.unitRoundRectUses });
+  return paths.back().path;
+}
+
+// Returns a shared path for `prim` in unit space, or VG_INVALID_HANDLE if it should be drawn from
+// the scratch path this time.
+static VGPath getUnitPath(const ScratchPrimitive &prim) {
+  switch (prim.kind) {
+    case ScratchPrimitive::ELLIPSE:
+      if (ctx.unitCircle == VG_INVALID_HANDLE) {
+        auto &data = beginTempPathData();
+        data.ellipse(0.0f, 0.0f, 1.0f, 1.0f);
+        ctx.unitCircle = createUnitPath(data);
+      }
+      return ctx.unitCircle;
+    case ScratchPrimitive::RECT:
+      if (ctx.unitSquare == VG_INVALID_HANDLE) {
+        auto &data = beginTempPathData();
+        data.rect(0.0f, 0.0f, 1.0f, 1.0f);
+        ctx.unitSquare = createUnitPath(data);
+      }
+      return ctx.unitSquare;
+    case ScratchPrimitive::ROUND_RECT:
+      return getUnitRoundRect(prim.rx / prim.w, prim.ry / prim.h);
+    default:
+      return VG_INVALID_HANDLE;
+  }
+}
+
+void moveTo(float x, float y) {
+  scratchData().moveTo(x, y);
+}
+void moveTo(const vec2 &pos) {
+  moveTo(pos.x, pos.y);
+}
+
+void lineTo(float x, float y) {
+  scratchData().lineTo(x, y);
+}
+void lineTo(const vec2 &pos) {
+  lineTo(pos.x, pos.y);
+}
+
+void cubicTo(float x1, float y1, float x2, float y2, float x3, float y3) {
+  scratchData().cubicTo(x1, y1, x2, y2, x3, y3);
+}
+void cubicTo(const vec2 &p1, const vec2 p2, const vec2 &p3) {
+  cubicTo(p1.x, p1.y, p2.x, p2.y, p3.x, p3.y);
+}
+
+void arc(float cx, float cy, float w, float h, float angleStart, float angleEnd) {
+  scratchData().arc(cx, cy, w, h, angleStart, angleEnd);
+}
+void arc(const vec2 &ctr, const vec2 &size, float angleStart, float angleEnd) {
+  arc(ctr.x, ctr.y, size.x, size.y, angleStart, angleEnd);
+}
+
+void circle(float cx, float cy, float radius) {
+  ellipse(cx, cy, radius, radius);
+}
+void circle(const vec2 &ctr, float radius) {
+  circle(ctr.x, ctr.y, radius);
+}
+
+void ellipse(float cx, float cy, float rx, float ry) {
+  if (rx <= 0.0f || ry <= 0.0f) return;
+  if (beginScratchPrimitive(ScratchPrimitive::ELLIPSE)) {
+    auto &prim = ctx.scratchPrimitive;
+    prim.x = cx;
+    prim.y = cy;
+    prim.rx = rx;
+    prim.ry = ry;
+  }
+  else {
+    scratchData().ellipse(cx, cy, rx, ry);
+  }
+}
+void ellipse(const vec2 &ctr, const vec2 &radius) {
+  ellipse(ctr.x, ctr.y, radius.x, radius.y);
+}
+
+void rect(float x, float y, float width, float height) {
+  if (width <= 0.0f || height <= 0.0f) return;
+  if (beginScratchPrimitive(ScratchPrimitive::RECT)) {
+    auto &prim = ctx.scratchPrimitive;
+    prim.x = x;
+    prim.y = y;
+    prim.w = width;
+    prim.h = height;
+  }
+  else {
+    scratchData().rect(x, y, width, height);
+  }
+}
+void rect(const vec2 &pos, const vec2 &size) {
+  rect(pos.x, pos.y, size.x, size.y);
+}
+void rect(const Rect &r) {
+  rect(r.pos, r.size);
+}
+
+void roundRect(float x, float y, float width, float height, float radius) {
+  if (width <= 0.0f || height <= 0.0f) return;
+  float rx = std::min(std::max(radius, 0.0f), width * 0.5f);
+  float ry = std::min(std::max(radius, 0.0f), height * 0.5f);
+  if (rx == 0.0f || ry == 0.0f) {
+    rect(x, y, width, height);
+  }
+  else if (beginScratchPrimitive(ScratchPrimitive::ROUND_RECT)) {
+    auto &prim = ctx.scratchPrimitive;
+    prim.x = x;
+    prim.y = y;
+    prim.w = width;
+    prim.h = height;
+    prim.rx = rx;
+    prim.ry = ry;
+  }
+  else {
+    scratchData().roundRect(x, y, width, height, rx, ry);
+  }
+}
+void roundRect(const vec2 &pos, const vec2 &size, float radius) {
+  roundRect(pos.x, pos.y, size.x, size.y, radius);
+}
+void roundRect(const Rect &r, float radius) {
+  roundRect(r.pos, r.size, radius);
+}
+
+void polyline(const vec2 *pts, size_t count) {
+  scratchData().polyline(pts, count);
+}
+void polyline(const float *samples, size_t count, size_t stride, float x, float dx, float y,
+              float yScale) {
+  scratchData().polyline(samples, count, stride, x, dx, y, yScale);
+}
+
+void polygon(const vec2 *pts, size_t count) {
+  scratchData().polyline(pts, count, true);
+}
+
+
+//
+// Waveforms
+//
+
+static const WaveformSummary &getWaveformSummary(const float *samples, size_t count) {
+  auto &cache = ctx.waveforms;
+  ++ctx.waveformUses;
+  for (auto &entry : cache) {
+    if (entry.samples == samples && entry.count == count) {
+      entry.lastUse = ctx.waveformUses;
+      return entry.summary;
+    }
+  }
+
+  if (cache.size() >= MAX_CACHED_WAVEFORMS) {
+    cache.erase(std::min_element(cache.begin(), cache.end(),
+                                 [](const CachedWaveform &l, const CachedWaveform &r) {
+                                   return l.lastUse < r.lastUse;
+                                 }));
+  }
+  cache.push_back({ samples, count, {}, ctx.waveformUses });
+  cache.back().summary.build(samples, count);
+  return cache.back().summary;
+}
+
+void waveform(const float *samples, size_t count, const Rect &bounds, float columnWidth) {
+  waveform(samples, count, bounds, 0, count, columnWidth);
+}
+
+// The outline runs left to right along the column maxima and back along the minima. Each column
+// also takes in the first sample of the next one, so the outline follows the line between them
+// even when zoomed in to a sample per column or less, and is padded to a pixel thick so flat
+// stretches don't collapse to nothing.
+void waveform(const float *samples, size_t count, const Rect &bounds, size_t first,
+              size_t visibleCount, float columnWidth) {
+  if (first >= count || visibleCount == 0 || bounds.size.x <= 0.0f) return;
+  visibleCount = std::min(visibleCount, count - first);
+
+  // The size of a pixel in user units, for the default column width and the minimum thickness
+  float scale = sqrtf(fabsf(ctx.transformStack[ctx.transformDepth].determinant()));
+  if (columnWidth <= 0.0f) columnWidth = scale > 0.0f ? 1.0f / scale : 1.0f;
+
+  const auto &summary = getWaveformSummary(samples, count);
+  size_t numColumns = std::max<size_t>(1, static_cast<size_t>(bounds.size.x / columnWidth));
+  double samplesPerColumn = static_cast<double>(visibleCount) / numColumns;
+  float step = bounds.size.x / numColumns;
+  float yScale = bounds.size.y * 0.5f;
+  float yCenter = bounds.pos.y + yScale;
+
+  // The thickness of a pixel, in samples
+  float minSpan = scale > 0.0f && yScale != 0.0f ? 1.0f / (scale * fabsf(yScale)) : 0.0f;
+
+  auto &envelope = ctx.waveformEnvelope;
+  envelope.resize(numColumns * 2);
+  for (size_t c = 0; c < numColumns; ++c) {
+    // Zoomed in past one sample per column, neighbouring columns share a sample
+    size_t begin = first + std::min(static_cast<size_t>(c * samplesPerColumn), visibleCount - 1);
+    size_t end = first + static_cast<size_t>((c + 1) * samplesPerColumn);
+    end = std::min(std::max(end, begin + 1) + 1, count);
+    float &min = envelope[c * 2], &max = envelope[c * 2 + 1];
+    summary.rangeMinMax(samples, begin, end, min, max);
+
+    float grow = (minSpan - (max - min)) * 0.5f;
+    if (grow > 0.0f) {
+      min -= grow;
+      max += grow;
+    }
+  }
+
+  auto &data = scratchData();
+  float x = bounds.pos.x + step * 0.5f;
+  data.moveTo(x, yCenter + envelope[1] * yScale);
+  for (size_t c = 1; c < numColumns; ++c) {
+    data.lineTo(x + step * c, yCenter + envelope[c * 2 + 1] * yScale);
+  }
+  for (size_t c = numColumns; c-- > 0;) {
+    data.lineTo(x + step * c, yCenter + envelope[c * 2] * yScale);
+  }
+  data.close();
+}
+
+void invalidateWaveform(const float *samples) {
+  auto &cache = ctx.waveforms;
+  cache.erase(std::remove_if(cache.begin(), cache.end(),
+                             [samples](const CachedWaveform &entry) {
+                               return entry.samples == samples;
+                             }),
+              cache.end());
+}
+
+void clearWaveformCache() {
+  ctx.waveforms.clear();
+}
+
+
+void fillRule(VGFillRule rule) {
+  if (ctx.state.fillRule.update(rule)) {
+    flushPendingDraw();
+    vgSeti(VG_FILL_RULE, rule);
+  }
+}
+
+void fillRuleEvenOdd() {
+  fillRule(VG_EVEN_ODD);
+}
+
+void fillRuleNonZero() {
+  fillRule(VG_NON_ZERO);
+}
+
+VGFillRule getFillRule() {
+  if (!ctx.state.fillRule.valid) ctx.state.fillRule.update(vgGeti(VG_FILL_RULE));
+  return static_cast<VGFillRule>(ctx.state.fillRule.value);
+}
+
+
+static bool isOpaqueDraw(VGbitfield paintModes) {
+  return (!(paintModes & VG_FILL_PATH) || ctx.fillOpaque) &&
+         (!(paintModes & VG_STROKE_PATH) || ctx.strokeOpaque) &&
+         !getMaskEnabled() && !ctx.state.colorTransformEnabled.value;
+}
+
+// OpenVG applies antialiasing coverage after blending, so SRC only differs from SRC_OVER where the
+// source alpha is below one. Choosing it for opaque draws lets the backend skip the destination read.
+static void updateBlendMode(VGbitfield paintModes) {
+  auto mode = ctx.blendMode;
+  if (mode == VG_BLEND_SRC_OVER && ctx.opaqueFastPath && isOpaqueDraw(paintModes))
+    mode = VG_BLEND_SRC;
+  if (ctx.state.blendMode.update(mode)) {
+    flushPendingDraw();
+    vgSeti(VG_BLEND_MODE, mode);
+  }
+}
+
+static void submitPath(VGPath path, VGbitfield paintModes) {
+  flushPendingDraw();
+  if (ctx.drawingToMask) {
+    vgRenderToMask(path, paintModes, ctx.maskOperation);
+  } else {
+    syncColorTransform(paintModes);
+    updateBlendMode(paintModes);
+    vgDrawPath(path, paintModes);
+  }
+}
+
+static void renderPath(VGPath path, VGbitfield paintModes) {
+  flushTransform();
+  submitPath(path, paintModes);
+}
+
+// Draws `path` with `placement` applied before the current transform.
+static void renderPath(VGPath path, VGbitfield paintModes, const Affine &placement) {
+  loadPathMatrix(ctx.transformStack[ctx.transformDepth] * placement);
+  // The next plain draw has to go back to the current transform
+  ctx.transformDirty = true;
+  submitPath(path, paintModes);
+}
+
+//
+// Draw Coalescing
+//
+
+// Draws everything collected by queueScratchPath. OpenVG state was brought up to date when the
+// draws were queued, and every state change flushes first, so it still matches.
+static void flushPendingDraw() {
+  if (ctx.pendingModes == 0) return;
+  auto paintModes = ctx.pendingModes;
+  ctx.pendingModes = 0;
+
+  if (ctx.pendingPath == VG_INVALID_HANDLE) {
+    ctx.pendingPath = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f, 0, 0,
+                                   VG_PATH_CAPABILITY_APPEND_TO);
+  }
+  else {
+    vgClearPath(ctx.pendingPath, VG_PATH_CAPABILITY_APPEND_TO);
+  }
+  ctx.pendingData.appendTo(ctx.pendingPath);
+  ctx.pendingData.clear();
+  ctx.pendingBounds.clear();
+
+  if (ctx.pendingToMask) {
+    vgRenderToMask(ctx.pendingPath, paintModes, ctx.pendingMaskOperation);
+  } else {
+    vgDrawPath(ctx.pendingPath, paintModes);
+  }
+}
+
+// Conservative bounds of the stroked or filled data in the user space of `xf`, including a pixel of
+// antialiasing on every side so shapes that only share an edge still count as overlapping.
+static Bounds getDrawBounds(const PathData &data, VGbitfield paintModes, const Affine &xf) {
+  Bounds b = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+  for (size_t i = 0; i + 1 < data.coords.size(); i += 2) {
+    b.minX = std::min(b.minX, data.coords[i]);
+    b.maxX = std::max(b.maxX, data.coords[i]);
+    b.minY = std::min(b.minY, data.coords[i + 1]);
+    b.maxY = std::max(b.maxY, data.coords[i + 1]);
+  }
+  if (paintModes & VG_STROKE_PATH) {
+    // Miters reach out up to the miter limit, which we leave at OpenVG's default of 4. Square caps
+    // reach half the width times sqrt(2).
+    float reach = getStrokeWidth() * 0.5f * (getStrokeJoin() == VG_JOIN_MITER ? 4.0f : 1.5f);
+    b.minX -= reach;
+    b.minY -= reach;
+    b.maxX += reach;
+    b.maxY += reach;
+  }
+
+  // A pixel in surface space reaches at most this far along either user space axis
+  auto inv = invert(xf);
+  float pad = std::max(fabsf(inv.a) + fabsf(inv.c), fabsf(inv.b) + fabsf(inv.d));
+  b.minX -= pad;
+  b.minY -= pad;
+  b.maxX += pad;
+  b.maxY += pad;
+  return b;
+}
+
+// Returns the scratch path data mapped into the space of the pending draw, or null if drawing it
+// there would look different. Fills survive any affine map, strokes only a translation, and
+// gradients are defined in user space so they must stay where they are.
+static const PathData *mapToPendingTransform(const PathData &data, VGbitfield paintModes) {
+  bool solid = (!(paintModes & VG_FILL_PATH) || ctx.fillSolid) &&
+               (!(paintModes & VG_STROKE_PATH) || ctx.strokeSolid);
+  if (!solid) return nullptr;
+
+  auto relative = invert(ctx.pendingTransform) * ctx.transformStack[ctx.transformDepth];
+  bool translation = relative.a == 1.0f && relative.b == 0.0f && relative.c == 0.0f &&
+                     relative.d == 1.0f;
+  if ((paintModes & VG_STROKE_PATH) && !translation) return nullptr;
+  if (relative.determinant() == 0.0f) return nullptr;
+
+  auto &mapped = beginTempPathData();
+  mapped.segments = data.segments;
+  mapped.coords.resize(data.coords.size());
+  transformPoints(relative, reinterpret_cast<const vec2 *>(data.coords.data()),
+                  reinterpret_cast<vec2 *>(mapped.coords.data()), data.coords.size() / 2);
+  return &mapped;
+}
+
+// Adds the scratch path to the pending draw. Shapes are only merged when they are at least a pixel
+// apart, so their antialiased edges don't meet, and mask draws must union or subtract.
+static void queueScratchPath(VGbitfield paintModes) {
+  const auto &scratch = scratchData();
+  if (scratch.empty()) return;
+
+  // Any state these change draws what is pending first
+  if (!ctx.drawingToMask) {
+    syncColorTransform(paintModes);
+    updateBlendMode(paintModes);
+  }
+  else if (ctx.maskOperation != VG_UNION_MASK && ctx.maskOperation != VG_SUBTRACT_MASK) {
+    renderPath(flushScratchPath(), paintModes);
+    return;
+  }
+
+  const PathData *data = &scratch;
+  Bounds bounds;
+  if (ctx.pendingModes != 0) {
+    bool compatible = ctx.pendingModes == paintModes && ctx.pendingToMask == ctx.drawingToMask &&
+                      (!ctx.drawingToMask || ctx.pendingMaskOperation == ctx.maskOperation) &&
+                      ctx.pendingBounds.size() < MAX_COALESCED_SHAPES;
+
+    // Geometry under a different transform can often join by being mapped into the pending
+    // draw's space rather than loading a new matrix.
+    if (compatible && ctx.transformStack[ctx.transformDepth] != ctx.pendingTransform) {
+      data = mapToPendingTransform(scratch, paintModes);
+      compatible = data != nullptr;
+    }
+    if (compatible) {
+      bounds = getDrawBounds(*data, paintModes, ctx.pendingTransform);
+      for (size_t i = 0; compatible && i < ctx.pendingBounds.size(); ++i) {
+        compatible = !ctx.pendingBounds[i].overlaps(bounds);
+      }
+    }
+    if (!compatible) {
+      flushPendingDraw();
+      data = &scratch;
+    }
+  }
+
+  if (ctx.pendingModes == 0) {
+    flushTransform();
+    bounds = getDrawBounds(*data, paintModes, ctx.transformStack[ctx.transformDepth]);
+    ctx.pendingTransform = ctx.transformStack[ctx.transformDepth];
+    ctx.pendingModes = paintModes;
+    ctx.pendingToMask = ctx.drawingToMask;
+    ctx.pendingMaskOperation = ctx.maskOperation;
+  }
+
+  ctx.pendingData.segments.insert(ctx.pendingData.segments.end(), data->segments.begin(),
+                                  data->segments.end());
+  ctx.pendingData.coords.insert(ctx.pendingData.coords.end(), data->coords.begin(),
+                                data->coords.end());
+  ctx.pendingBounds.push_back(bounds);
+}
+
+void enableDrawCoalescing() {
+  ctx.coalesceDraws = true;
+}
+void disableDrawCoalescing() {
+  flushPendingDraw();
+  ctx.coalesceDraws = false;
+}
+
+void flushDraws() {
+  flushPendingDraw();
+}
+
+// Draws the scratch path, using a shared unit path when it holds a single primitive. Strokes can
+// only go through the unit path under a uniform placement, with the width scaled to match.
+// Gradients are defined in user space, so their paint matrices have to undo the placement; a
+// gradient whose matrix isn't known goes through the scratch path instead.
+static void renderScratchPath(VGbitfield paintModes) {
+  if (ctx.coalesceDraws) {
+    queueScratchPath(paintModes);
+    return;
+  }
+
+  const auto &prim = ctx.scratchPrimitive;
+  bool fillGradient = !ctx.drawingToMask && (paintModes & VG_FILL_PATH) && !ctx.fillSolid;
+  bool strokeGradient = !ctx.drawingToMask && (paintModes & VG_STROKE_PATH) && !ctx.strokeSolid;
+  VGPath path = VG_INVALID_HANDLE;
+  if (prim.kind != ScratchPrimitive::NONE && (!(paintModes & VG_STROKE_PATH) || prim.uniform()) &&
+      (!fillGradient || ctx.state.fillPaintMatrix.valid) &&
+      (!strokeGradient || ctx.state.strokePaintMatrix.valid)) {
+    path = getUnitPath(prim);
+  }
+  if (path == VG_INVALID_HANDLE) {
+    VGPath cached = VG_INVALID_HANDLE;
+    if (ctx.geometryCache.enabled) cached = getCachedGeometry(scratchData());
+    renderPath(cached != VG_INVALID_HANDLE ? cached : flushScratchPath(), paintModes);
+    return;
+  }
+
+  auto placement = prim.placement();
+  auto unplace = invert(placement);
+  auto fillMatrix = ctx.state.fillPaintMatrix.value;
+  auto strokeMatrix = ctx.state.strokePaintMatrix.value;
+  if (fillGradient) setPaintMatrix(unplace * fillMatrix, VG_FILL_PATH);
+  if (strokeGradient) setPaintMatrix(unplace * strokeMatrix, VG_STROKE_PATH);
+
+  if (paintModes & VG_STROKE_PATH) {
+    float width = getStrokeWidth();
+    strokeWidth(width / placement.a);
+    renderPath(path, paintModes, placement);
+    strokeWidth(width);
+  }
+  else {
+    renderPath(path, paintModes, placement);
+  }
+
+  if (fillGradient) setPaintMatrix(fillMatrix, VG_FILL_PATH);
+  if (strokeGradient) setPaintMatrix(strokeMatrix, VG_STROKE_PATH);
+}
+
+void blendMode(VGBlendMode mode) {
+  ctx.blendMode = mode;
+}
+
+VGBlendMode getBlendMode() {
+  return ctx.blendMode;
+}
+
+void enableOpaqueFastPath() {
+  ctx.opaqueFastPath = true;
+}
+void disableOpaqueFastPath() {
+  ctx.opaqueFastPath = false;
+}
+
+void fill() {
+  renderScratchPath(VG_FILL_PATH);
+}
+void stroke() {
+  renderScratchPath(VG_STROKE_PATH);
+}
+void fillAndStroke() {
+  renderScratchPath(VG_FILL_PATH | VG_STROKE_PATH);
+}
+
+// Fills `data` in `color` with one draw. The non-zero rule makes overlapping shapes merge rather
+// than cancel; the previous fill paint and rule are restored afterwards.
+static void fillBatch(const PathData &data, uint32_t color) {
+  if (data.empty()) return;
+
+  if (ctx.batchPath == VG_INVALID_HANDLE) {
+    ctx.batchPath = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f, 0, 0,
+                                 VG_PATH_CAPABILITY_APPEND_TO);
+  }
+  else {
+    vgClearPath(ctx.batchPath, VG_PATH_CAPABILITY_APPEND_TO);
+  }
+  data.appendTo(ctx.batchPath);
+
+  pushStyle(STYLE_FILL_PAINT | STYLE_FILL_RULE);
+  setSolidPaint(color, VG_FILL_PATH);
+  fillRule(VG_NON_ZERO);
+  renderPath(ctx.batchPath, VG_FILL_PATH);
+  popStyle();
+}
+
+void fillRects(const Rect *rects, size_t count, uint32_t color) {
+  auto &data = beginTempPathData();
+  for (size_t i = 0; i < count; ++i) {
+    data.rect(rects[i].pos.x, rects[i].pos.y, rects[i].size.x, rects[i].size.y);
+  }
+  fillBatch(data, color);
+}
+void fillRects(const Rect *rects, size_t count, const vec4 &color) {
+  fillRects(rects, count, packRGBA(color.r, color.g, color.b, color.a));
+}
+
+void fillCircles(const vec2 *centers, const float *radii, size_t count, uint32_t color) {
+  auto &data = beginTempPathData();
+  for (size_t i = 0; i < count; ++i) {
+    data.ellipse(centers[i].x, centers[i].y, radii[i], radii[i]);
+  }
+  fillBatch(data, color);
+}
+void fillCircles(const vec2 *centers, const float *radii, size_t count, const vec4 &color) {
+  fillCircles(centers, radii, count, packRGBA(color.r, color.g, color.b, color.a));
+}
+
+
+//
+// Stroke Cache
+//
+
+// Nothing sets VG_STROKE_MITER_LIMIT, so OpenVG strokes with its default
+static const float DEFAULT_MITER_LIMIT = 4.0f;
+// Maximum distance in pixels between a cached outline and the true stroke
+static const float STROKE_TOLERANCE = 0.25f;
+
+// Returns the current stroke of `data` as fill geometry, or VG_INVALID_HANDLE if OpenVG should
+// stroke it this time. Outlines are flattened for the current scale rounded up to a half-octave
+// bucket, so zooming only rebuilds them every so often.
+static VGPath getStrokeGeometry(const PathData &data, uint64_t hash) {
+  auto &cache = ctx.strokeCache;
+  if (!cache.enabled || data.empty()) return VG_INVALID_HANDLE;
+  // The outline is drawn with the stroke paint, so it has to be known
+  if (!ctx.strokeSolid && !ctx.state.strokePaint.valid) return VG_INVALID_HANDLE;
+
+  StrokeStyle style = { getStrokeWidth(), getStrokeCap(), getStrokeJoin(), DEFAULT_MITER_LIMIT };
+  if (style.width <= 0.0f) return VG_INVALID_HANDLE;
+
+  float scale = sqrtf(fabsf(ctx.transformStack[ctx.transformDepth].determinant()));
+  int bucket = static_cast<int>(ceilf(log2f(std::max(scale, 1e-6f)) * 2.0f));
+  bucket = std::min(std::max(bucket, -32), 32);
+
+  uint32_t widthBits;
+  memcpy(&widthBits, &style.width, sizeof(widthBits));
+  uint64_t variant = (uint64_t(widthBits) << 32) | ((style.cap - VG_CAP_BUTT) << 16) |
+                     ((style.join - VG_JOIN_MITER) << 8) | uint64_t(bucket + 32);
+  uint64_t key = (hash ^ variant) * 1099511628211ull;
+
+  auto path = findGeometry(cache, key, data, variant);
+  if (path != VG_INVALID_HANDLE) return path;
+  // The outline's size is only known once it is built, and it is usually several times the size
+  // of the path, so outlines that turn out too large are remembered instead
+  if (cache.oversized.count(key) || !isRepeatMiss(cache, key)) return VG_INVALID_HANDLE;
+
+  auto &outline = ctx.strokeOutline;
+  outline.clear();
+  strokeToFill(data, style, STROKE_TOLERANCE / exp2f(bucket * 0.5f), ctx.strokeLines, outline);
+  size_t bytes = getPathDataBytes(outline) + getPathDataBytes(data);
+  if (outline.empty() || bytes > cache.budget) {
+    rejectGeometry(cache, key);
+    return VG_INVALID_HANDLE;
+  }
+
+  path = outline.createPath(0);
+  retainGeometry(cache, key, data, variant, path, bytes);
+  return path;
+}
+
+// Fills a stroke outline with the current stroke paint. The non-zero rule is what makes the
+// overlapping pieces of the outline cover the stroke once.
+static void fillWithStrokePaint(VGPath outline) {
+  pushStyle(STYLE_FILL_PAINT | STYLE_FILL_RULE);
+  if (ctx.strokeSolid) {
+    setSolidPaint(ctx.strokeRGBA, VG_FILL_PATH);
+  }
+  else {
+    if (ctx.state.strokePaintMatrix.valid)
+      setPaintMatrix(ctx.state.strokePaintMatrix.value, VG_FILL_PATH);
+    setNonSolidPaint({ ctx.state.strokePaint.value, ctx.strokeOpaque }, VG_FILL_PATH);
+  }
+  fillRule(VG_NON_ZERO);
+  renderPath(outline, VG_FILL_PATH);
+  popStyle();
+}
+
+void enableStrokeCache() {
+  ctx.strokeCache.enabled = true;
+}
+void disableStrokeCache() {
+  clearStrokeCache();
+  ctx.strokeCache.enabled = false;
+}
+
+void setStrokeCacheBudget(size_t bytes) {
+  auto &cache = ctx.strokeCache;
+  cache.budget = bytes;
+  cache.oversized.clear();
+  while (cache.bytes > cache.budget) evictGeometry(cache);
+}
+
+void clearStrokeCache() {
+  clearGeometry(ctx.strokeCache);
+}
+
+GeometryCacheStats getStrokeCacheStats() {
+  return getGeometryStats(ctx.strokeCache);
+}
+
+void resetStrokeCacheStats() {
+  ctx.strokeCache.stats = {};
+}
+
+
+//
+// Retained Paths
+//
+
+Path::Path() : data{ new PathData } {}
+
+Path::Path(Path &&other)
+: data{ std::move(other.data) }
+, handle{ other.handle }
+, uploadedSegments{ other.uploadedSegments }
+, uploadedCoords{ other.uploadedCoords }
+, hash{ other.hash }
+, hashValid{ other.hashValid } {
+  other.data.reset(new PathData);
+  other.handle = VG_INVALID_HANDLE;
+  other.modified();
+}
+
+Path &Path::operator=(Path &&other) {
+  if (this != &other) {
+    if (handle != VG_INVALID_HANDLE) vgDestroyPath(handle);
+    data = std::move(other.data);
+    handle = other.handle;
+    uploadedSegments = other.uploadedSegments;
+    uploadedCoords = other.uploadedCoords;
+    hash = other.hash;
+    hashValid = other.hashValid;
+    other.data.reset(new PathData);
+    other.handle = VG_INVALID_HANDLE;
+    other.modified();
+  }
+  return *this;
+}
+
+Path::~Path() {
+  if (handle != VG_INVALID_HANDLE) vgDestroyPath(handle);
+}
+
+void Path::modified() {
+  hashValid = false;
+}
+
+// The VGPath is created on first use so Paths can be constructed before there is an OpenVG context.
+VGPath Path::getHandle() const {
+  if (data->empty()) return VG_INVALID_HANDLE;
+  if (handle == VG_INVALID_HANDLE) {
+    handle = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f,
+                          static_cast<VGint>(data->segments.size()),
+                          static_cast<VGint>(data->coords.size()), VG_PATH_CAPABILITY_APPEND_TO);
+  }
+  data->appendTo(handle, uploadedSegments, uploadedCoords);
+  uploadedSegments = data->segments.size();
+  uploadedCoords = data->coords.size();
+  return handle;
+}
+
+uint64_t Path::getHash() const {
+  if (!hashValid) {
+    hash = data->hash();
+    hashValid = true;
+  }
+  return hash;
+}
+
+void Path::clear() {
+  data->clear();
+  uploadedSegments = uploadedCoords = 0;
+  modified();
+  if (handle != VG_INVALID_HANDLE) vgClearPath(handle, VG_PATH_CAPABILITY_APPEND_TO);
+}
+
+void Path::moveTo(float x, float y) {
+  data->moveTo(x, y);
+  modified();
+}
+void Path::moveTo(const vec2 &pos) {
+  moveTo(pos.x, pos.y);
+}
+
+void Path::lineTo(float x, float y) {
+  data->lineTo(x, y);
+  modified();
+}
+void Path::lineTo(const vec2 &pos) {
+  lineTo(pos.x, pos.y);
+}
+
+void Path::cubicTo(float x1, float y1, float x2, float y2, float x3, float y3) {
+  data->cubicTo(x1, y1, x2, y2, x3, y3);
+  modified();
+}
+void Path::cubicTo(const vec2 &p1, const vec2 &p2, const vec2 &p3) {
+  cubicTo(p1.x, p1.y, p2.x, p2.y, p3.x, p3.y);
+}
+
+void Path::arc(float cx, float cy, float w, float h, float angleStart, float angleEnd) {
+  data->arc(cx, cy, w, h, angleStart, angleEnd);
+  modified();
+}
+void Path::arc(const vec2 &ctr, const vec2 &size, float angleStart, float angleEnd) {
+  arc(ctr.x, ctr.y, size.x, size.y, angleStart, angleEnd);
+}
+
+void Path::circle(float cx, float cy, float radius) {
+  data->ellipse(cx, cy, radius, radius);
+  modified();
+}
+void Path::circle(const vec2 &ctr, float radius) {
+  circle(ctr.x, ctr.y, radius);
+}
+
+void Path::ellipse(float cx, float cy, float rx, float ry) {
+  data->ellipse(cx, cy, rx, ry);
+  modified();
+}
+void Path::ellipse(const vec2 &ctr, const vec2 &radius) {
+  ellipse(ctr.x, ctr.y, radius.x, radius.y);
+}
+
+void Path::rect(float x, float y, float width, float height) {
+  data->rect(x, y, width, height);
+  modified();
+}
+void Path::rect(const vec2 &pos, const vec2 &size) {
+  rect(pos.x, pos.y, size.x, size.y);
+}
+void Path::rect(const Rect &r) {
+  rect(r.pos, r.size);
+}
+
+void Path::roundRect(float x, float y, float width, float height, float radius) {
+  data->roundRect(x, y, width, height, radius);
+  modified();
+}
+void Path::roundRect(const vec2 &pos, const vec2 &size, float radius) {
+  roundRect(pos.x, pos.y, size.x, size.y, radius);
+}
+void Path::roundRect(const Rect &r, float radius) {
+  roundRect(r.pos, r.size, radius);
+}
+
+void Path::polyline(const vec2 *pts, size_t count) {
+  data->polyline(pts, count);
+  modified();
+}
+void Path::polyline(const float *samples, size_t count, size_t stride, float x, float dx, float y,
+                    float yScale) {
+  data->polyline(samples, count, stride, x, dx, y, yScale);
+  modified();
 }
 
-void cubicTo(VGPath path, float x1, float y1, float x2, float y2, float x3, float y3) {
-  VGubyte segs[] = { VG_CUBIC_TO };
-  VGfloat coords[] = { x1, y1, x2, y2, x3, y3 };
-  vgAppendPathData(path, 1, segs, coords);
+void Path::polygon(const vec2 *pts, size_t count) {
+  data->polyline(pts, count, true);
+  modified();
 }
 
-static float RAD_TO_DEG = 180.0f / M_PI;
+SimplifyStats Path::simplify(float tolerance) {
+  SimplifyStats stats;
+  stats.segmentsBefore = data->segments.size();
+  data->simplify(tolerance);
+  stats.segmentsAfter = data->segments.size();
 
-void arc(VGPath path, float x, float y, float w, float h, float startAngle, float endAngle) {
-  float as = startAngle * RAD_TO_DEG;
-  float ae = (endAngle - startAngle) * RAD_TO_DEG;
-  vguArc(path, x, y, w, h, as, ae, VGU_ARC_OPEN);
+  // The VGPath has to be rebuilt from scratch
+  uploadedSegments = uploadedCoords = 0;
+  modified();
+  if (handle != VG_INVALID_HANDLE) vgClearPath(handle, VG_PATH_CAPABILITY_APPEND_TO);
+  return stats;
 }
 
-void circle(VGPath path, float x, float y, float radius) {
-  auto d = radius * 2.0f;
-  vguEllipse(path, x, y, d, d);
+void Path::append(const PathData &other) {
+  data->segments.insert(data->segments.end(), other.segments.begin(), other.segments.end());
+  data->coords.insert(data->coords.end(), other.coords.begin(), other.coords.end());
+  modified();
 }
 
-void ellipse(VGPath path, float x, float y, float rx, float ry) {
-  vguEllipse(path, x, y, rx * 2.0f, ry * 2.0f);
+void fill(const Path &path) {
+  auto handle = path.getHandle();
+  if (handle != VG_INVALID_HANDLE) renderPath(handle, VG_FILL_PATH);
+}
+void stroke(const Path &path) {
+  auto handle = path.getHandle();
+  if (handle == VG_INVALID_HANDLE) return;
+  auto outline = getStrokeGeometry(path.getData(), path.getHash());
+  if (outline != VG_INVALID_HANDLE) fillWithStrokePaint(outline);
+  else renderPath(handle, VG_STROKE_PATH);
+}
+void fillAndStroke(const Path &path) {
+  auto handle = path.getHandle();
+  if (handle == VG_INVALID_HANDLE) return;
+  auto outline = getStrokeGeometry(path.getData(), path.getHash());
+  if (outline != VG_INVALID_HANDLE) {
+    renderPath(handle, VG_FILL_PATH);
+    fillWithStrokePaint(outline);
+  }
+  else {
+    renderPath(handle, VG_FILL_PATH | VG_STROKE_PATH);
+  }
 }
 
-void rect(VGPath path, float x, float y, float width, float height) {
-  vguRect(path, x, y, width, height);
+Path combinePaths(const Path &a, const Path &b, PathOp op, VGFillRule fillRule, float tolerance) {
+  auto &data = beginTempPathData();
+  Path path;
+  if (combinePaths(a.getData(), b.getData(), op, fillRule, tolerance, data)) path.append(data);
+  return path;
 }
 
-void roundRect(VGPath path, float x, float y, float width, float height, float radius) {
-  vguRoundRect(path, x, y, width, height, radius * 2.0f, radius * 2.0f);
+void drawInstances(VGPath path, const mat3 *xforms, const uint32_t *colors, size_t count,
+                   VGbitfield paintModes) {
+  if (path == VG_INVALID_HANDLE || count == 0) return;
+
+  const auto &base = ctx.transformStack[ctx.transformDepth];
+  auto &transforms = ctx.instanceTransforms;
+  transforms.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    transforms[i] = base * Affine(xforms[i]);
+  }
+
+  if (colors == nullptr) {
+    for (size_t i = 0; i < count; ++i) {
+      loadPathMatrix(transforms[i]);
+      submitPath(path, paintModes);
+    }
+  }
+  else {
+    auto &order = ctx.instanceOrder;
+    order.resize(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [colors](uint32_t l, uint32_t r) { return colors[l] < colors[r]; });
+
+    pushStyle(((paintModes & VG_FILL_PATH) ? STYLE_FILL_PAINT : 0) |
+              ((paintModes & VG_STROKE_PATH) ? STYLE_STROKE_PAINT : 0));
+    for (size_t i = 0; i < count; ++i) {
+      auto index = order[i];
+      if (i == 0 || colors[index] != colors[order[i - 1]]) setSolidPaint(colors[index], paintModes);
+      loadPathMatrix(transforms[index]);
+      submitPath(path, paintModes);
+    }
+    popStyle();
+  }
+
+  // The next plain draw has to go back to the current transform
+  ctx.transformDirty = true;
+}
+
+void drawInstances(const Path &path, const mat3 *xforms, const uint32_t *colors, size_t count,
+                   VGbitfield paintModes) {
+  drawInstances(path.getHandle(), xforms, colors, count, paintModes);
 }
 
 
 //
-// Scratch Path Operators
+// Dynamic Paths
 //
 
-void beginPath() {
-  if (ctx.scratchPath == VG_INVALID_HANDLE) {
-    ctx.scratchPath = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f, 0, 0,
-                                   VG_PATH_CAPABILITY_ALL);
+static const VGbitfield DYNAMIC_PATH_CAPABILITIES =
+    VG_PATH_CAPABILITY_APPEND_TO | VG_PATH_CAPABILITY_MODIFY;
+
+DynamicPath::DynamicPath() : data{ new PathData } {}
+
+DynamicPath::DynamicPath(DynamicPath &&other)
+: data{ std::move(other.data) }
+, uploadedSegments{ std::move(other.uploadedSegments) }
+, handle{ other.handle }
+, ring{ std::move(other.ring) }
+, ringHead{ other.ringHead }
+, ringY{ other.ringY }
+, ringYScale{ other.ringYScale }
+, ringDirty{ other.ringDirty } {
+  other.data.reset(new PathData);
+  other.handle = VG_INVALID_HANDLE;
+}
+
+DynamicPath &DynamicPath::operator=(DynamicPath &&other) {
+  if (this != &other) {
+    if (handle != VG_INVALID_HANDLE) vgDestroyPath(handle);
+    data = std::move(other.data);
+    uploadedSegments = std::move(other.uploadedSegments);
+    handle = other.handle;
+    ring = std::move(other.ring);
+    ringHead = other.ringHead;
+    ringY = other.ringY;
+    ringYScale = other.ringYScale;
+    ringDirty = other.ringDirty;
+    other.data.reset(new PathData);
+    other.handle = VG_INVALID_HANDLE;
+  }
+  return *this;
+}
+
+DynamicPath::~DynamicPath() {
+  if (handle != VG_INVALID_HANDLE) vgDestroyPath(handle);
+}
+
+void DynamicPath::begin() {
+  data->clear();
+  ring.clear();
+  ringDirty = false;
+}
+
+// Rewrites the coordinates in place if the segments are unchanged, otherwise replaces the path data.
+void DynamicPath::end() {
+  if (handle == VG_INVALID_HANDLE) {
+    handle = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f,
+                          static_cast<VGint>(data->segments.size()),
+                          static_cast<VGint>(data->coords.size()), DYNAMIC_PATH_CAPABILITIES);
+  }
+  else if (data->segments == uploadedSegments) {
+    if (!uploadedSegments.empty()) {
+      vgModifyPathCoords(handle, 0, static_cast<VGint>(uploadedSegments.size()),
+                         data->coords.data());
+    }
+    return;
   }
   else {
-    vgClearPath(ctx.scratchPath, VG_PATH_CAPABILITY_ALL);
+    vgClearPath(handle, DYNAMIC_PATH_CAPABILITIES);
   }
+
+  data->appendTo(handle);
+  uploadedSegments = data->segments;
 }
 
-void moveTo(float x, float y) {
-  moveTo(ctx.scratchPath, x, y);
+void DynamicPath::moveTo(float x, float y) {
+  data->moveTo(x, y);
 }
-void moveTo(const vec2 &pos) {
+void DynamicPath::moveTo(const vec2 &pos) {
   moveTo(pos.x, pos.y);
 }
 
-void lineTo(float x, float y) {
-  lineTo(ctx.scratchPath, x, y);
+void DynamicPath::lineTo(float x, float y) {
+  data->lineTo(x, y);
 }
-void lineTo(const vec2 &pos) {
+void DynamicPath::lineTo(const vec2 &pos) {
   lineTo(pos.x, pos.y);
 }
 
-void cubicTo(float x1, float y1, float x2, float y2, float x3, float y3) {
-  cubicTo(ctx.scratchPath, x1, y1, x2, y2, x3, y3);
+void DynamicPath::cubicTo(float x1, float y1, float x2, float y2, float x3, float y3) {
+  data->cubicTo(x1, y1, x2, y2, x3, y3);
 }
-void cubicTo(const vec2 &p1, const vec2 p2, const vec2 &p3) {
+void DynamicPath::cubicTo(const vec2 &p1, const vec2 &p2, const vec2 &p3) {
   cubicTo(p1.x, p1.y, p2.x, p2.y, p3.x, p3.y);
 }
 
-void arc(float cx, float cy, float w, float h, float angleStart, float angleEnd) {
-  arc(ctx.scratchPath, cx, cy, w, h, angleStart, angleEnd);
+void DynamicPath::arc(float cx, float cy, float w, float h, float angleStart, float angleEnd) {
+  data->arc(cx, cy, w, h, angleStart, angleEnd, 4);
 }
-void arc(const vec2 &ctr, const vec2 &size, float angleStart, float angleEnd) {
+void DynamicPath::arc(const vec2 &ctr, const vec2 &size, float angleStart, float angleEnd) {
   arc(ctr.x, ctr.y, size.x, size.y, angleStart, angleEnd);
 }
 
-void circle(float cx, float cy, float radius) {
-  circle(ctx.scratchPath, cx, cy, radius);
+void DynamicPath::polyline(const vec2 *pts, size_t count) {
+  data->polyline(pts, count);
 }
-void circle(const vec2 &ctr, float radius) {
-  circle(ctr.x, ctr.y, radius);
+void DynamicPath::polyline(const float *samples, size_t count, size_t stride, float x, float dx,
+                           float y, float yScale) {
+  data->polyline(samples, count, stride, x, dx, y, yScale);
 }
 
-void ellipse(float cx, float cy, float rx, float ry) {
-  ellipse(ctx.scratchPath, cx, cy, rx, ry);
+void DynamicPath::close() {
+  data->close();
 }
-void ellipse(const vec2 &ctr, const vec2 &radius) {
-  ellipse(ctr.x, ctr.y, radius.x, radius.y);
+
+void DynamicPath::beginRing(size_t numPoints, float x, float dx, float y, float yScale) {
+  begin();
+  ring.assign(numPoints, 0.0f);
+  ringHead = 0;
+  ringY = y;
+  ringYScale = yScale;
+  data->polyline(ring.data(), numPoints, 1, x, dx, y, yScale);
+  end();
+  ringDirty = false;
 }
 
-void rect(float x, float y, float width, float height) {
-  rect(ctx.scratchPath, x, y, width, height);
+void DynamicPath::pushSamples(const float *samples, size_t count, size_t stride) {
+  if (ring.empty()) return;
+  // Only the last numPoints samples can still be seen
+  if (count > ring.size()) {
+    samples += (count - ring.size()) * stride;
+    count = ring.size();
+  }
+  for (size_t i = 0; i < count; ++i) {
+    ring[ringHead] = samples[i * stride];
+    if (++ringHead == ring.size()) ringHead = 0;
+  }
+  ringDirty = ringDirty || count > 0;
+}
+
+// ringHead is the oldest sample, so the ring is unrolled from there into the y coordinates and
+// uploaded with a single vgModifyPathCoords.
+VGPath DynamicPath::getHandle() const {
+  if (ringDirty) {
+    ringDirty = false;
+    VGfloat *ys = data->coords.data() + 1;
+    size_t n = ring.size();
+    for (size_t i = 0, j = ringHead; i < n; ++i) {
+      ys[i * 2] = ringY + ring[j] * ringYScale;
+      if (++j == n) j = 0;
+    }
+    vgModifyPathCoords(handle, 0, static_cast<VGint>(n), data->coords.data());
+  }
+  return handle;
 }
-void rect(const vec2 &pos, const vec2 &size) {
-  rect(pos.x, pos.y, size.x, size.y);
+
+void fill(const DynamicPath &path) {
+  auto handle = path.getHandle();
+  if (handle != VG_INVALID_HANDLE) renderPath(handle, VG_FILL_PATH);
 }
-void rect(const Rect &r) {
-  rect(r.pos, r.size);
+void stroke(const DynamicPath &path) {
+  auto handle = path.getHandle();
+  if (handle != VG_INVALID_HANDLE) renderPath(handle, VG_STROKE_PATH);
+}
+void fillAndStroke(const DynamicPath &path) {
+  auto handle = path.getHandle();
+  if (handle != VG_INVALID_HANDLE) renderPath(handle, VG_FILL_PATH | VG_STROKE_PATH);
 }
 
-void roundRect(float x, float y, float width, float height, float radius) {
-  roundRect(ctx.scratchPath, x, y, width, height, radius);
+
+//
+// Path Morphing
+//
+
+// The start point of a subpath followed by three points per cubic, as NanoSVG stores them.
+using CubicSubpath = std::vector<vec2>;
+
+static void splitLongestCubic(CubicSubpath &subpath) {
+  size_t longest = 0;
+  float longestLength = -1.0f;
+  for (size_t i = 0; i + 3 < subpath.size(); i += 3) {
+    float length = glm::length(subpath[i + 1] - subpath[i]) +
+                   glm::length(subpath[i + 2] - subpath[i + 1]) +
+                   glm::length(subpath[i + 3] - subpath[i + 2]);
+    if (length > longestLength) {
+      longest = i;
+      longestLength = length;
+    }
+  }
+
+  // de Casteljau at t = 0.5
+  vec2 *p = &subpath[longest];
+  vec2 p01 = (p[0] + p[1]) * 0.5f, p12 = (p[1] + p[2]) * 0.5f, p23 = (p[2] + p[3]) * 0.5f;
+  vec2 p012 = (p01 + p12) * 0.5f, p123 = (p12 + p23) * 0.5f;
+  vec2 mid = (p012 + p123) * 0.5f;
+  vec2 end = p[3];
+  p[1] = p01;
+  p[2] = p012;
+  p[3] = mid;
+  vec2 tail[] = { p123, p23, end };
+  subpath.insert(subpath.begin() + longest + 4, tail, tail + 3);
+}
+
+static void getCubicSubpaths(const NSVGshape &shape, std::vector<CubicSubpath> &subpaths) {
+  for (auto path = shape.paths; path != NULL; path = path->next) {
+    if (path->npts < 1) continue;
+    auto pts = reinterpret_cast<const vec2 *>(path->pts);
+    subpaths.emplace_back(pts, pts + 1 + (path->npts - 1) / 3 * 3);
+  }
 }
-void roundRect(const vec2 &pos, const vec2 &size, float radius) {
-  roundRect(pos.x, pos.y, size.x, size.y, radius);
+
+// Pads and splits both lists so that they have the same number of subpaths and each pair has the
+// same number of cubics.
+static void matchSubpaths(std::vector<CubicSubpath> &a, std::vector<CubicSubpath> &b) {
+  auto grow = [](std::vector<CubicSubpath> &shorter, const std::vector<CubicSubpath> &longer) {
+    while (shorter.size() < longer.size()) {
+      const auto &other = longer[shorter.size()];
+      vec2 center;
+      for (const auto &p : other) center += p;
+      shorter.emplace_back(4, center * (1.0f / other.size()));
+    }
+  };
+  grow(a, b);
+  grow(b, a);
+
+  for (size_t i = 0; i < a.size(); ++i) {
+    auto &sa = a[i], &sb = b[i];
+    // A lone moveTo becomes a point-sized cubic so it can be split
+    if (sa.size() == 1) sa.resize(4, sa[0]);
+    if (sb.size() == 1) sb.resize(4, sb[0]);
+    while (sa.size() < sb.size()) splitLongestCubic(sa);
+    while (sb.size() < sa.size()) splitLongestCubic(sb);
+  }
 }
-void roundRect(const Rect &r, float radius) {
-  roundRect(r.pos, r.size, radius);
+
+PathMorph::PathMorph(const NSVGshape &from, const NSVGshape &to) {
+  setPaths(from, to);
+}
+
+PathMorph::PathMorph(PathMorph &&other)
+: from{ other.from }
+, to{ other.to }
+, target{ other.target }
+, segments{ std::move(other.segments) }
+, fromCoords{ std::move(other.fromCoords) }
+, toCoords{ std::move(other.toCoords) }
+, coords{ std::move(other.coords) }
+, blendOnCpu{ other.blendOnCpu } {
+  other.from = other.to = other.target = VG_INVALID_HANDLE;
+}
+
+PathMorph &PathMorph::operator=(PathMorph &&other) {
+  if (this != &other) {
+    destroy();
+    from = other.from;
+    to = other.to;
+    target = other.target;
+    segments = std::move(other.segments);
+    fromCoords = std::move(other.fromCoords);
+    toCoords = std::move(other.toCoords);
+    coords = std::move(other.coords);
+    blendOnCpu = other.blendOnCpu;
+    other.from = other.to = other.target = VG_INVALID_HANDLE;
+  }
+  return *this;
 }
 
+PathMorph::~PathMorph() {
+  destroy();
+}
 
-void fillRuleEvenOdd() {
-  vgSeti(VG_FILL_RULE, VG_EVEN_ODD);
+void PathMorph::destroy() {
+  if (from != VG_INVALID_HANDLE) vgDestroyPath(from);
+  if (to != VG_INVALID_HANDLE) vgDestroyPath(to);
+  if (target != VG_INVALID_HANDLE) vgDestroyPath(target);
+  from = to = target = VG_INVALID_HANDLE;
 }
 
-void fillRuleNonZero() {
-  vgSeti(VG_FILL_RULE, VG_NON_ZERO);
+static const VGbitfield MORPH_TARGET_CAPABILITIES =
+    VG_PATH_CAPABILITY_APPEND_TO | VG_PATH_CAPABILITY_MODIFY | VG_PATH_CAPABILITY_INTERPOLATE_TO;
+
+void PathMorph::setPaths(const NSVGshape &fromShape, const NSVGshape &toShape) {
+  destroy();
+  segments.clear();
+  fromCoords.clear();
+  toCoords.clear();
+  blendOnCpu = false;
+
+  std::vector<CubicSubpath> a, b;
+  getCubicSubpaths(fromShape, a);
+  getCubicSubpaths(toShape, b);
+  matchSubpaths(a, b);
+
+  for (size_t i = 0; i < a.size(); ++i) {
+    segments.push_back(VG_MOVE_TO_ABS);
+    segments.insert(segments.end(), (a[i].size() - 1) / 3, VG_CUBIC_TO_ABS);
+    auto pa = reinterpret_cast<const VGfloat *>(a[i].data());
+    auto pb = reinterpret_cast<const VGfloat *>(b[i].data());
+    fromCoords.insert(fromCoords.end(), pa, pa + a[i].size() * 2);
+    toCoords.insert(toCoords.end(), pb, pb + b[i].size() * 2);
+  }
+  coords = fromCoords;
+
+  auto numSegments = static_cast<VGint>(segments.size());
+  auto numCoords = static_cast<VGint>(coords.size());
+  from = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f, numSegments,
+                      numCoords, VG_PATH_CAPABILITY_APPEND_TO | VG_PATH_CAPABILITY_INTERPOLATE_FROM);
+  to = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f, numSegments,
+                    numCoords, VG_PATH_CAPABILITY_APPEND_TO | VG_PATH_CAPABILITY_INTERPOLATE_FROM);
+  target = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f, numSegments,
+                        numCoords, MORPH_TARGET_CAPABILITIES);
+  if (segments.empty()) return;
+
+  vgAppendPathData(from, numSegments, segments.data(), fromCoords.data());
+  vgAppendPathData(to, numSegments, segments.data(), toCoords.data());
+  vgAppendPathData(target, numSegments, segments.data(), fromCoords.data());
+  vgRemovePathCapabilities(from, VG_PATH_CAPABILITY_APPEND_TO);
+  vgRemovePathCapabilities(to, VG_PATH_CAPABILITY_APPEND_TO);
+}
+
+void PathMorph::morph(float t) {
+  if (segments.empty()) return;
+
+  if (!blendOnCpu) {
+    vgClearPath(target, MORPH_TARGET_CAPABILITIES);
+    if (vgInterpolatePath(target, from, to, t) == VG_TRUE) return;
+
+    // The target was cleared, so give it its segments back before blending into it
+    blendOnCpu = true;
+    vgAppendPathData(target, static_cast<VGint>(segments.size()), segments.data(),
+                     fromCoords.data());
+  }
+
+  for (size_t i = 0; i < coords.size(); ++i) {
+    coords[i] = fromCoords[i] + (toCoords[i] - fromCoords[i]) * t;
+  }
+  vgModifyPathCoords(target, 0, static_cast<VGint>(segments.size()), coords.data());
 }
 
-VGFillRule getFillRule() {
-  return static_cast<VGFillRule>(vgGeti(VG_FILL_RULE));
+void fill(const PathMorph &morph) {
+  if (morph.getHandle() != VG_INVALID_HANDLE) renderPath(morph.getHandle(), VG_FILL_PATH);
+}
+void stroke(const PathMorph &morph) {
+  if (morph.getHandle() != VG_INVALID_HANDLE) renderPath(morph.getHandle(), VG_STROKE_PATH);
+}
+void fillAndStroke(const PathMorph &morph) {
+  if (morph.getHandle() != VG_INVALID_HANDLE)
+    renderPath(morph.getHandle(), VG_FILL_PATH | VG_STROKE_PATH);
 }
 
 
-static void renderPath(VGPath path, VGbitfield paintModes) {
-  if (ctx.drawingToMask) {
-    vgRenderToMask(path, paintModes, ctx.maskOperation);
-  } else {
-    vgDrawPath(path, paintModes);
+//
+// Path Measurement
+//
+
+PathMeasure::PathMeasure(float tolerance) : tolerance{ std::max(tolerance, 1e-3f) } {}
+
+// A subpath that never got past its first point has no length to measure, so it is dropped.
+void PathMeasure::endSubpath() {
+  if (!subpaths.empty() && subpaths.back() == points.size() - 1) {
+    points.pop_back();
+    distances.pop_back();
+    subpaths.pop_back();
   }
 }
 
-void fill() {
-  renderPath(ctx.scratchPath, VG_FILL_PATH);
+void PathMeasure::beginSubpath(const vec2 &p) {
+  endSubpath();
+  subpaths.push_back(points.size());
+  points.push_back(p);
+  distances.push_back(distances.empty() ? 0.0f : distances.back());
 }
-void stroke() {
-  renderPath(ctx.scratchPath, VG_STROKE_PATH);
+
+void PathMeasure::addPoint(const vec2 &p) {
+  distances.push_back(distances.back() + glm::length(p - points.back()));
+  points.push_back(p);
 }
-void fillAndStroke() {
-  renderPath(ctx.scratchPath, VG_FILL_PATH | VG_STROKE_PATH);
+
+void PathMeasure::setPath(const NSVGshape &shape) {
+  points.clear();
+  distances.clear();
+  subpaths.clear();
+
+  for (auto path = shape.paths; path != NULL; path = path->next) {
+    if (path->npts < 1) continue;
+    beginSubpath(vec2(path->pts[0], path->pts[1]));
+    for (int i = 0; i < path->npts - 1; i += 3) {
+      const float *c = &path->pts[i * 2];
+      vec2 p0(c[0], c[1]), p1(c[2], c[3]), p2(c[4], c[5]), p3(c[6], c[7]);
+      float dd = std::max(glm::length(p0 - 2.0f * p1 + p2), glm::length(p1 - 2.0f * p2 + p3));
+      int steps = getFlatteningSteps(dd, 3, tolerance);
+      for (int k = 1; k <= steps; ++k) {
+        float t = static_cast<float>(k) / steps, u = 1.0f - t;
+        addPoint(u * u * u * p0 + 3.0f * u * u * t * p1 + 3.0f * u * t * t * p2 + t * t * t * p3);
+      }
+    }
+    if (path->closed) addPoint(points[subpaths.back()]);
+  }
+  endSubpath();
+}
+
+void PathMeasure::setPath(const PathData &data) {
+  points.clear();
+  distances.clear();
+  subpaths.clear();
+
+  std::vector<Polyline> lines;
+  data.flatten(tolerance, lines);
+  for (const auto &line : lines) {
+    beginSubpath(line.points[0]);
+    // Repeated points would be zero-length steps inside the subpath
+    for (size_t i = 1; i < line.points.size(); ++i) {
+      if (line.points[i] != points.back()) addPoint(line.points[i]);
+    }
+    if (line.closed && line.points[0] != points.back()) addPoint(line.points[0]);
+  }
+  endSubpath();
+}
+
+void PathMeasure::setPath(const Path &path) {
+  setPath(path.getData());
+}
+
+bool PathMeasure::setPath(VGPath path) {
+  points.clear();
+  distances.clear();
+  subpaths.clear();
+
+  const VGbitfield required = VG_PATH_CAPABILITY_PATH_LENGTH |
+                              VG_PATH_CAPABILITY_POINT_ALONG_PATH |
+                              VG_PATH_CAPABILITY_TANGENT_ALONG_PATH;
+  // An invalid handle has no capabilities either
+  if ((vgGetPathCapabilities(path) & required) != required) return false;
+
+  vec2 end;
+  VGint numSegments = vgGetParameteri(path, VG_PATH_NUM_SEGMENTS);
+  for (VGint i = 0; i < numSegments; ++i) {
+    VGfloat length = vgPathLength(path, i, 1);
+    if (length <= 0.0f) continue;
+
+    vec2 p0, t0, p1, t1;
+    vgPointAlongPath(path, i, 1, 0.0f, &p0.x, &p0.y, &t0.x, &t0.y);
+    vgPointAlongPath(path, i, 1, length, &p1.x, &p1.y, &t1.x, &t1.y);
+    // Segments that don't continue from the previous one follow a moveTo
+    if (points.empty() || glm::length(p0 - end) > tolerance) beginSubpath(p0);
+
+    // Lines keep their tangent along the chord; anything else is sampled evenly
+    vec2 chord = p1 - p0;
+    float bend = std::max(fabsf(t0.x * chord.y - t0.y * chord.x),
+                          fabsf(t1.x * chord.y - t1.y * chord.x));
+    int steps = bend <= tolerance ? 1 : getFlatteningSteps(length, 2, tolerance);
+    for (int k = 1; k < steps; ++k) {
+      vec2 p;
+      vgPointAlongPath(path, i, 1, length * k / steps, &p.x, &p.y, nullptr, nullptr);
+      addPoint(p);
+    }
+    addPoint(p1);
+    end = p1;
+  }
+  endSubpath();
+  return true;
+}
+
+float PathMeasure::getLength() const {
+  return distances.empty() ? 0.0f : distances.back();
+}
+
+// Returns the index of the end point of the segment containing `distance`, searching the points
+// [first, last). Zero-length steps only occur between subpaths, and the search never ends on one.
+size_t PathMeasure::findSegment(float distance, size_t first, size_t last) const {
+  auto begin = distances.begin() + first, end = distances.begin() + last;
+  size_t i = std::upper_bound(begin + 1, end, distance) - distances.begin();
+  if (i >= last) {
+    i = last - 1;
+    while (i > first + 1 && distances[i] == distances[i - 1]) --i;
+  }
+  return i;
+}
+
+vec2 PathMeasure::getPosition(float distance, size_t first, size_t last) const {
+  if (last - first < 2) return points[first];
+  auto i = findSegment(distance, first, last);
+  float length = distances[i] - distances[i - 1];
+  float t = length > 0.0f ? (distance - distances[i - 1]) / length : 0.0f;
+  t = std::min(std::max(t, 0.0f), 1.0f);
+  return points[i - 1] + (points[i] - points[i - 1]) * t;
+}
+
+vec2 PathMeasure::getPosition(float distance) const {
+  if (points.empty()) return vec2();
+  return getPosition(distance, 0, points.size());
+}
+
+vec2 PathMeasure::getTangent(float distance) const {
+  if (points.size() < 2) return vec2(1.0f, 0.0f);
+  auto i = findSegment(distance, 0, points.size());
+  auto d = points[i] - points[i - 1];
+  float length = glm::length(d);
+  return length > 0.0f ? d / length : vec2(1.0f, 0.0f);
+}
+
+void PathMeasure::trimPath(float start, float end, DynamicPath &out) const {
+  out.begin();
+  for (size_t k = 0; k < subpaths.size() && start < end; ++k) {
+    size_t first = subpaths[k];
+    size_t last = k + 1 < subpaths.size() ? subpaths[k + 1] : points.size();
+    float d0 = distances[first], d1 = distances[last - 1];
+    if (d1 <= start || d0 >= end) continue;
+
+    float s = std::max(start, d0), e = std::min(end, d1);
+    vec2 ps = getPosition(s, first, last), pe = getPosition(e, first, last);
+    out.moveTo(ps);
+    for (size_t i = first + 1; i < last; ++i) {
+      out.lineTo(distances[i] <= s ? ps : distances[i] >= e ? pe : points[i]);
+    }
+  }
+  out.end();
 }
 
 
 void clearColor(float r, float g, float b, float a) {
   VGfloat color[] = { r, g, b, a };
-  vgSetfv(VG_CLEAR_COLOR, 4, color);
+  if (ctx.state.clearColor.update({ r, g, b, a })) vgSetfv(VG_CLEAR_COLOR, 4, color);
 }
 void clearColor(const vec4 &color) {
   clearColor(color.r, color.g, color.b, color.a);
@@ -371,6 +2737,7 @@ void clearColor(const vec3 &color) {
 }
 
 void clear(int x, int y, int w, int h) {
+  flushPendingDraw();
   vgClear(x, y, w, h);
 }
 void clear(const vec2 &pos, const vec2 &size) {
@@ -385,13 +2752,26 @@ void clear(const Rect &rect){
 // SVG
 //
 
-void drawSvg(const Svg &svg, bool flipY) {
-  if (flipY) {
-    // TODO(ryan): Combine this into one matrix multiply. No need to use the user facing API here.
-    pushTransform();
-    translate(0.0f, svg.height);
-    scale(1.0f, -1.0f);
+// SVG y runs down from the top, so by default the image is flipped to fit OpenVG's y-up space.
+static void pushSvgFlip(float height) {
+  pushTransform();
+  auto &xf = ctx.transformStack[ctx.transformDepth];
+  xf = xf * Affine(1.0f, 0.0f, 0.0f, -1.0f, 0.0f, height);
+  invalidateTransform();
+}
+
+static void appendNSVGshape(const NSVGshape &shape, PathData &data) {
+  for (auto path = shape.paths; path != NULL; path = path->next) {
+    data.moveTo(path->pts[0], path->pts[1]);
+    for (int i = 0; i < path->npts - 1; i += 3) {
+      float *p = &path->pts[i * 2];
+      data.cubicTo(p[2], p[3], p[4], p[5], p[6], p[7]);
+    }
   }
+}
+
+void drawSvg(const Svg &svg, bool flipY) {
+  if (flipY) pushSvgFlip(svg.height);
 
   for (auto shape = svg.shapes; shape != NULL; shape = shape->next) {
     bool hasStroke = shape->stroke.type != NSVG_PAINT_NONE;
@@ -408,20 +2788,20 @@ void drawSvg(const Svg &svg, bool flipY) {
       strokePaint(shape->stroke, shape->opacity);
     }
 
-    auto vgPath = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_F, 1.0f, 0.0f, 0, 0,
-                               VG_PATH_CAPABILITY_ALL);
-
-    for (auto path = shape->paths; path != NULL; path = path->next) {
-      moveTo(vgPath, path->pts[0], path->pts[1]);
-      for (int i = 0; i < path->npts - 1; i += 3) {
-        float *p = &path->pts[i * 2];
-        cubicTo(vgPath, p[2], p[3], p[4], p[5], p[6], p[7]);
-      }
+    auto &data = beginTempPathData();
+    appendNSVGshape(*shape, data);
+    auto outline = hasStroke && ctx.strokeCache.enabled ? getStrokeGeometry(data, data.hash())
+                                                        : VG_INVALID_HANDLE;
+    if (outline != VG_INVALID_HANDLE) hasStroke = false;
+
+    if (hasFill || hasStroke) {
+      // Drawing needs no capabilities, so the path can be stored in whatever form suits the driver
+      auto vgPath = data.createPath(0, ctx.svgTolerance, &ctx.svgQuantizedCoords);
+      renderPath(vgPath, (hasFill   ? VG_FILL_PATH   : 0) |
+                         (hasStroke ? VG_STROKE_PATH : 0));
+      vgDestroyPath(vgPath);
     }
-
-    renderPath(vgPath, (hasFill   ? VG_FILL_PATH   : 0) |
-                       (hasStroke ? VG_STROKE_PATH : 0));
-    vgDestroyPath(vgPath);
+    if (outline != VG_INVALID_HANDLE) fillWithStrokePaint(outline);
   }
 
   if (flipY) popTransform();
@@ -431,36 +2811,111 @@ void drawSvg(const Svg *img, bool flipY) {
   drawSvg(*img, flipY);
 }
 
+static void compileNSVGpaint(const NSVGpaint &svgPaint, float opacity, CompiledSvg::Paint &out) {
+  if (svgPaint.type == NSVG_PAINT_COLOR) {
+    out.rgba = getNSVGcolor(svgPaint, opacity);
+    out.opaque = (out.rgba >> 24) == 0xff;
+  }
+  else {
+    GradientKey key;
+    out.paintToUser = getNSVGgradientKey(svgPaint, opacity, key, out.opaque).toMat3();
+    out.paint = createGradientPaint(key);
+  }
+}
+
+CompiledSvg::CompiledSvg(const Svg &svg) : width{ svg.width }, height{ svg.height } {
+  auto &data = beginTempPathData();
+  for (auto shape = svg.shapes; shape != NULL; shape = shape->next) {
+    bool hasStroke = shape->stroke.type != NSVG_PAINT_NONE;
+    bool hasFill = shape->fill.type != NSVG_PAINT_NONE;
+    if (!hasFill && !hasStroke) continue;
 
-//
-// Color Transform
-//
+    data.clear();
+    appendNSVGshape(*shape, data);
 
-void setColorTransform(float sr, float sg, float sb, float sa,
-                       float br, float bg, float bb, float ba) {
-  VGfloat xf[] = { sr, sg, sb, sa, br, bg, bb, ba };
-  vgSetfv(VG_COLOR_TRANSFORM_VALUES, 8, xf);
+    Shape compiled;
+    compiled.path = data.createPath(0, ctx.svgTolerance, &ctx.svgQuantizedCoords);
+    compiled.paintModes = (hasFill ? VG_FILL_PATH : 0) | (hasStroke ? VG_STROKE_PATH : 0);
+    if (hasFill) compileNSVGpaint(shape->fill, shape->opacity, compiled.fill);
+    if (hasStroke) {
+      compileNSVGpaint(shape->stroke, shape->opacity, compiled.stroke);
+      compiled.strokeWidth = shape->strokeWidth;
+      compiled.strokeCap = fromNSVG(static_cast<NSVGlineCap>(shape->strokeLineCap));
+      compiled.strokeJoin = fromNSVG(static_cast<NSVGlineJoin>(shape->strokeLineJoin));
+    }
+    shapes.push_back(compiled);
+  }
 }
 
-void setColorTransform(const vec4 &scale, const vec4 &bias) {
-  setColorTransform(scale.r, scale.g, scale.b, scale.a, bias.r, bias.g, bias.b, bias.a);
+CompiledSvg::CompiledSvg(CompiledSvg &&other)
+: shapes{ std::move(other.shapes) }, width{ other.width }, height{ other.height } {
+  other.shapes.clear();
 }
 
-const std::pair<vec4, vec4> getColorTransform() {
-  VGfloat xf[8];
-  vgGetfv(VG_COLOR_TRANSFORM_VALUES, 8, xf);
-  return { { xf[0], xf[1], xf[2], xf[3] }, { xf[4], xf[5], xf[6], xf[7] } };
+CompiledSvg &CompiledSvg::operator=(CompiledSvg &&other) {
+  if (this != &other) {
+    destroy();
+    shapes = std::move(other.shapes);
+    width = other.width;
+    height = other.height;
+    other.shapes.clear();
+  }
+  return *this;
 }
 
-void enableColorTransform() {
-  vgSeti(VG_COLOR_TRANSFORM, VG_TRUE);
+CompiledSvg::~CompiledSvg() {
+  destroy();
 }
-void disableColorTransform() {
-  vgSeti(VG_COLOR_TRANSFORM, VG_FALSE);
+
+// Paints go through destroyPaint in case a saved style still refers to them.
+void CompiledSvg::destroy() {
+  for (auto &shape : shapes) {
+    vgDestroyPath(shape.path);
+    if (shape.fill.paint != VG_INVALID_HANDLE) destroyPaint(shape.fill.paint);
+    if (shape.stroke.paint != VG_INVALID_HANDLE) destroyPaint(shape.stroke.paint);
+  }
+  shapes.clear();
 }
 
-bool getColorTransformEnabled() {
-  return vgGeti(VG_COLOR_TRANSFORM) == VG_TRUE;
+CompiledSvg compileSvg(const Svg &svg) {
+  return CompiledSvg(svg);
+}
+
+static void setCompiledPaint(const CompiledSvg::Paint &paint, VGPaintMode paintMode) {
+  if (paint.paint == VG_INVALID_HANDLE) {
+    setSolidPaint(paint.rgba, paintMode);
+  }
+  else {
+    setPaintMatrix(Affine(paint.paintToUser), paintMode);
+    setNonSolidPaint({ paint.paint, paint.opaque }, paintMode);
+  }
+}
+
+void drawSvg(const CompiledSvg &svg, bool flipY) {
+  if (flipY) pushSvgFlip(svg.getHeight());
+
+  for (const auto &shape : svg.getShapes()) {
+    if (shape.paintModes & VG_FILL_PATH) {
+      setCompiledPaint(shape.fill, VG_FILL_PATH);
+    }
+    if (shape.paintModes & VG_STROKE_PATH) {
+      strokeWidth(shape.strokeWidth);
+      strokeJoin(shape.strokeJoin);
+      strokeCap(shape.strokeCap);
+      setCompiledPaint(shape.stroke, VG_STROKE_PATH);
+    }
+    renderPath(shape.path, shape.paintModes);
+  }
+
+  if (flipY) popTransform();
+}
+
+void svgTolerance(float tolerance) {
+  ctx.svgTolerance = std::max(tolerance, 0.0f);
+}
+
+float getSvgTolerance() {
+  return ctx.svgTolerance;
 }
 
 
@@ -469,6 +2924,7 @@ bool getColorTransformEnabled() {
 //
 
 void pushMask(int width, int height) {
+  flushPendingDraw();
   auto layer = vgCreateMaskLayer(width, height);
   vgCopyMask(layer, 0, 0, 0, 0, width, height);
   ctx.maskStack.push_back({ layer, width, height });
@@ -478,6 +2934,7 @@ void pushMask(const vec2 &size) {
 }
 
 void popMask() {
+  flushPendingDraw();
   auto &mask = ctx.maskStack.back();
   vgMask(mask.layer, VG_SET_MASK, 0, 0, mask.width, mask.height);
   vgDestroyMaskLayer(mask.layer);
@@ -485,6 +2942,7 @@ void popMask() {
 }
 
 void beginMask() {
+  flushPendingDraw();
   if (ctx.maskStack.size() > 0) {
     auto &mask = ctx.maskStack.back();
     clearMask(0, 0, mask.width, mask.height);
@@ -492,6 +2950,7 @@ void beginMask() {
   ctx.drawingToMask = true;
 }
 void endMask() {
+  flushPendingDraw();
   if (ctx.maskStack.size() > 0) {
     auto &mask = ctx.maskStack.back();
     vgMask(mask.layer, VG_INTERSECT_MASK, 0, 0, mask.width, mask.height);
@@ -499,14 +2958,27 @@ void endMask() {
   ctx.drawingToMask = false;
 }
 
+static void setMaskEnabled(bool enabled) {
+  if (ctx.state.masking.update(enabled)) {
+    flushPendingDraw();
+    vgSeti(VG_MASKING, enabled ? VG_TRUE : VG_FALSE);
+  }
+}
+
 void enableMask() {
-  vgSeti(VG_MASKING, VG_TRUE);
+  setMaskEnabled(true);
 }
 void disableMask() {
-  vgSeti(VG_MASKING, VG_FALSE);
+  setMaskEnabled(false);
+}
+
+bool getMaskEnabled() {
+  if (!ctx.state.masking.valid) ctx.state.masking.update(vgGeti(VG_MASKING) == VG_TRUE);
+  return ctx.state.masking.value;
 }
 
 void fillMask(int x, int y, int width, int height) {
+  flushPendingDraw();
   vgMask(0, VG_FILL_MASK, x, y, width, height);
 }
 void fillMask(const vec2 &pos, const vec2 &size) {
@@ -517,6 +2989,7 @@ void fillMask(const Rect &rect) {
 }
 
 void clearMask(int x, int y, int width, int height) {
+  flushPendingDraw();
   vgMask(0, VG_CLEAR_MASK, x, y, width, height);
 }
 void clearMask(const vec2 &pos, const vec2 &size) {
@@ -532,54 +3005,185 @@ void maskOperation(VGMaskOperation operation) {
 
 
 //
-// Transform Stack
+// Style Stack
 //
 
-static void loadTransform() {
-  vgLoadMatrix(&ctx.transformStack.back()[0][0]);
+// Reads a paint that was never set through this API back from OpenVG, along with its matrix.
+// VG_INVALID_HANDLE stands for OpenVG's default paint, which is opaque black.
+static void resolvePaint(VGPaintMode paintMode, Shadow<VGPaint> &paint, Shadow<Affine> &matrix,
+                         bool &opaque) {
+  if (!paint.valid) {
+    paint.update(vgGetPaint(paintMode));
+    opaque = paint.value == VG_INVALID_HANDLE;
+  }
+  if (!matrix.valid) {
+    setMatrixMode(paintMode == VG_FILL_PATH ? VG_MATRIX_FILL_PAINT_TO_USER
+                                            : VG_MATRIX_STROKE_PAINT_TO_USER);
+    VGfloat m[9];
+    vgGetMatrix(m);
+    matrix.update({ m[0], m[1], m[3], m[4], m[6], m[7] });
+  }
+}
+
+// Fields whose value is unknown because they were never set through this API are read back from
+// OpenVG once, like the getters do, so that popStyle() can restore every field it saved.
+void pushStyle(uint32_t flags) {
+  auto &state = ctx.state;
+
+  Style style;
+  style.flags = flags;
+  // Solid colors are saved by value and looked up again on pop, so only gradient paints need to be
+  // kept alive.
+  if (flags & STYLE_FILL_PAINT) {
+    if (!ctx.fillSolid) {
+      resolvePaint(VG_FILL_PATH, state.fillPaint, state.fillPaintMatrix, ctx.fillOpaque);
+    }
+    style.fillSolid = ctx.fillSolid;
+    style.fillRGBA = ctx.fillRGBA;
+    style.fillPaint = state.fillPaint;
+    style.fillOpaque = ctx.fillOpaque;
+    style.fillPaintMatrix = state.fillPaintMatrix;
+    if (!style.fillSolid && style.fillPaint.value != VG_INVALID_HANDLE)
+      retainPaint(style.fillPaint.value);
+  }
+  if (flags & STYLE_STROKE_PAINT) {
+    if (!ctx.strokeSolid) {
+      resolvePaint(VG_STROKE_PATH, state.strokePaint, state.strokePaintMatrix, ctx.strokeOpaque);
+    }
+    style.strokeSolid = ctx.strokeSolid;
+    style.strokeRGBA = ctx.strokeRGBA;
+    style.strokePaint = state.strokePaint;
+    style.strokeOpaque = ctx.strokeOpaque;
+    style.strokePaintMatrix = state.strokePaintMatrix;
+    if (!style.strokeSolid && style.strokePaint.value != VG_INVALID_HANDLE)
+      retainPaint(style.strokePaint.value);
+  }
+  if (flags & STYLE_STROKE) {
+    getStrokeWidth();
+    getStrokeCap();
+    getStrokeJoin();
+    style.strokeWidth = state.strokeWidth;
+    style.strokeCap = state.strokeCap;
+    style.strokeJoin = state.strokeJoin;
+  }
+  if (flags & STYLE_FILL_RULE) {
+    getFillRule();
+    style.fillRule = state.fillRule;
+  }
+  if (flags & STYLE_COLOR_TRANSFORM) {
+    style.colorTransform = ctx.colorTransform;
+  }
+  if (flags & STYLE_MASK) {
+    getMaskEnabled();
+    style.masking = state.masking;
+    style.maskOperation = ctx.maskOperation;
+  }
+
+  ctx.styleStack.push_back(style);
+}
+
+void popStyle() {
+  const auto &style = ctx.styleStack.back();
+
+  // The setters compare against the shadow state, so only fields that changed reach OpenVG.
+  if (style.flags & STYLE_COLOR_TRANSFORM) {
+    ctx.colorTransform = style.colorTransform;
+    ctx.foldedPaintsDirty = true;
+  }
+  if (style.flags & STYLE_FILL_PAINT) {
+    if (style.fillSolid) {
+      setSolidPaint(style.fillRGBA, VG_FILL_PATH);
+    }
+    else {
+      setPaintMatrix(style.fillPaintMatrix.value, VG_FILL_PATH);
+      setNonSolidPaint({ style.fillPaint.value, style.fillOpaque }, VG_FILL_PATH);
+      if (style.fillPaint.value != VG_INVALID_HANDLE) releasePaint(style.fillPaint.value);
+    }
+  }
+  if (style.flags & STYLE_STROKE_PAINT) {
+    if (style.strokeSolid) {
+      setSolidPaint(style.strokeRGBA, VG_STROKE_PATH);
+    }
+    else {
+      setPaintMatrix(style.strokePaintMatrix.value, VG_STROKE_PATH);
+      setNonSolidPaint({ style.strokePaint.value, style.strokeOpaque }, VG_STROKE_PATH);
+      if (style.strokePaint.value != VG_INVALID_HANDLE) releasePaint(style.strokePaint.value);
+    }
+  }
+  if (style.flags & STYLE_STROKE) {
+    strokeWidth(style.strokeWidth.value);
+    strokeCap(static_cast<VGCapStyle>(style.strokeCap.value));
+    strokeJoin(static_cast<VGJoinStyle>(style.strokeJoin.value));
+  }
+  if (style.flags & STYLE_FILL_RULE) fillRule(static_cast<VGFillRule>(style.fillRule.value));
+  if (style.flags & STYLE_MASK) {
+    setMaskEnabled(style.masking.value);
+    ctx.maskOperation = style.maskOperation;
+  }
+
+  ctx.styleStack.pop_back();
 }
 
 
+//
+// Transform Stack
+//
+
+// Pushes past MAX_TRANSFORM_DEPTH are ignored along with their pops, so the stack never writes past
+// its end in release builds.
 void pushTransform() {
-  ctx.transformStack.push_back(ctx.transformStack.back());
+  assert(ctx.transformDepth + 1 < MAX_TRANSFORM_DEPTH && "transform stack overflow");
+  if (ctx.transformDepth + 1 == MAX_TRANSFORM_DEPTH) {
+    ++ctx.transformOverflow;
+    ++ctx.transformStats.overflows;
+    return;
+  }
+  ctx.transformStack[ctx.transformDepth + 1] = ctx.transformStack[ctx.transformDepth];
+  ++ctx.transformDepth;
 }
 
 void popTransform() {
-  ctx.transformStack.pop_back();
-  loadTransform();
+  if (ctx.transformOverflow > 0) {
+    --ctx.transformOverflow;
+    return;
+  }
+  assert(ctx.transformDepth > 0 && "transform stack underflow");
+  if (ctx.transformDepth == 0) return;
+  --ctx.transformDepth;
+  invalidateTransform();
 }
 
 void setTransform(const mat3 &xf) {
-  ctx.transformStack.back() = xf;
-  loadTransform();
+  ctx.transformStack[ctx.transformDepth] = Affine(xf);
+  invalidateTransform();
 }
 
 void setTransformIdentity() {
-  ctx.transformStack.back() = mat3();
-  loadTransform();
+  ctx.transformStack[ctx.transformDepth] = Affine();
+  invalidateTransform();
 }
 
 const mat3 getTransform() {
-  return ctx.transformStack.back();
+  return ctx.transformStack[ctx.transformDepth].toMat3();
 }
 
 
 void translate(const vec2 &vec) {
-  ctx.transformStack.back() = translate(ctx.transformStack.back(), vec);
-  loadTransform();
+  ctx.transformStack[ctx.transformDepth].translate(vec.x, vec.y);
+  invalidateTransform();
 }
 void translate(float x, float y) {
   translate(vec2(x, y));
 }
 
 void rotate(float radians) {
-  ctx.transformStack.back() = rotate(ctx.transformStack.back(), radians);
-  loadTransform();
+  ctx.transformStack[ctx.transformDepth].rotate(radians);
+  invalidateTransform();
 }
 
 void scale(const vec2 &vec) {
-  ctx.transformStack.back() = scale(ctx.transformStack.back(), vec);
-  loadTransform();
+  ctx.transformStack[ctx.transformDepth].scale(vec.x, vec.y);
+  invalidateTransform();
 }
 void scale(float x, float y) {
   scale(vec2(x, y));
@@ -588,6 +3192,14 @@ void scale(float s) {
   scale(vec2(s));
 }
 
+TransformStats getTransformStats() {
+  return ctx.transformStats;
+}
+
+void resetTransformStats() {
+  ctx.transformStats = {};
+}
+
 
 //
 // Svg Loading
@@ -597,6 +3209,48 @@ Svg *loadSvg(const std::string &path, const std::string &units, float dpi) {
   return nsvgParseFromFile(path.c_str(), units.c_str(), dpi);
 }
 
+// Each NanoSVG path is a start point followed by cubics. The simplified path never has more
+// segments, so it is written back into the same array, with lines as cubics like NanoSVG makes
+// them.
+SimplifyStats simplifySvg(Svg &svg, float tolerance) {
+  SimplifyStats stats;
+  auto &data = beginTempPathData();
+  for (auto shape = svg.shapes; shape != NULL; shape = shape->next) {
+    for (auto path = shape->paths; path != NULL; path = path->next) {
+      if (path->npts < 4) continue;
+
+      data.clear();
+      data.moveTo(path->pts[0], path->pts[1]);
+      for (int i = 0; i < path->npts - 1; i += 3) {
+        float *p = &path->pts[i * 2];
+        data.cubicTo(p[2], p[3], p[4], p[5], p[6], p[7]);
+      }
+      stats.segmentsBefore += path->npts / 3;
+      data.simplify(tolerance);
+
+      float *out = path->pts + 2;
+      const VGfloat *c = data.coords.data() + 2;
+      for (size_t i = 1; i < data.segments.size(); ++i) {
+        if (data.segments[i] == VG_CUBIC_TO_ABS) {
+          memcpy(out, c, 6 * sizeof(float));
+          c += 6;
+        }
+        else {
+          vec2 p0(out[-2], out[-1]), p1(c[0], c[1]);
+          vec2 c0 = p0 + (p1 - p0) * (1.0f / 3.0f), c1 = p1 + (p0 - p1) * (1.0f / 3.0f);
+          float cubic[] = { c0.x, c0.y, c1.x, c1.y, p1.x, p1.y };
+          memcpy(out, cubic, sizeof(cubic));
+          c += 2;
+        }
+        out += 6;
+      }
+      path->npts = 1 + static_cast<int>(data.segments.size() - 1) * 3;
+      stats.segmentsAfter += path->npts / 3;
+    }
+  }
+  return stats;
+}
+
 
 //
 // Text
@@ -653,8 +3307,8 @@ static VGFont createVGFontFromTTFont(const stbtt_fontinfo &info) {
 
     stbtt_FreeShape(&info, verts);
 
-    auto path = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_S_16, FONT_SCALE, 0.0f, 0, 0,
-                             VG_PATH_CAPABILITY_ALL);
+    auto path = vgCreatePath(VG_PATH_FORMAT_STANDARD, VG_PATH_DATATYPE_S_16, FONT_SCALE, 0.0f,
+                             numVerts, numCoords, VG_PATH_CAPABILITY_APPEND_TO);
     vgAppendPathData(path, numVerts, segs, coords);
 
     int advanceWidth;
@@ -820,21 +3474,26 @@ Rect getTextBounds(const std::string &text) {
 }
 
 void fillText(const std::string &text, float x, float y) {
+  flushPendingDraw();
   auto glyphData = getTextGlyphData(text);
   auto origin = getGlyphsOrigin(glyphData);
 
   vgSetfv(VG_GLYPH_ORIGIN, 2, &origin[0]);
 
-  auto prevMatrixMode = vgGeti(VG_MATRIX_MODE);
-  vgSeti(VG_MATRIX_MODE, VG_MATRIX_GLYPH_USER_TO_SURFACE);
-  loadTransform();
+  // The glyph matrix is rebuilt for every string, so it isn't shadowed.
+  VGfloat m[9];
+  ctx.transformStack[ctx.transformDepth].toVGMatrix(m);
+  setMatrixMode(VG_MATRIX_GLYPH_USER_TO_SURFACE);
+  vgLoadMatrix(m);
   vgTranslate(x, y);
   vgScale(ctx.fontSize, ctx.fontSize);
 
+  syncColorTransform(VG_FILL_PATH);
+  updateBlendMode(VG_FILL_PATH);
   vgDrawGlyphs(ctx.font, glyphData.glyphs.size(), &glyphData.glyphs[0], &glyphData.adjustmentsX[0],
                nullptr, VG_FILL_PATH, true);
 
-  vgSeti(VG_MATRIX_MODE, prevMatrixMode);
+  setMatrixMode(VG_MATRIX_PATH_USER_TO_SURFACE);
 }
 
 void fillText(const std::string &text) {
@@ -847,11 +3506,8 @@ void fillText(const std::string &text, const vec2 &pos) {
 
 
 ScopedColorTransform::ScopedColorTransform(float sr, float sg, float sb, float sa,
-                                           float br, float bg, float bb, float ba)
-: prevColorTransform{ getColorTransform() },
-  prevColorTransformEnabled{ getColorTransformEnabled() } {
-  setColorTransform(sr, sg, sb, sa, br, bg, bb, ba);
-  enableColorTransform();
+                                           float br, float bg, float bb, float ba) {
+  pushColorTransform(vec4(sr, sg, sb, sa), vec4(br, bg, bb, ba));
 }
 
 ScopedColorTransform::ScopedColorTransform(const vec4 &scale, const vec4 &bias)
@@ -859,11 +3515,7 @@ ScopedColorTransform::ScopedColorTransform(const vec4 &scale, const vec4 &bias)
 }
 
 ScopedColorTransform::~ScopedColorTransform() {
-  setColorTransform(prevColorTransform.first, prevColorTransform.second);
-  if (prevColorTransformEnabled)
-    enableColorTransform();
-  else
-    disableColorTransform();
+  popColorTransform();
 }
 
 } // otto
@@ -2,13 +2,19 @@
 
 #include <VG/openvg.h>
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <nanosvg.h>
 #include <glm/glm.hpp>
 
+#include "path_ops.hpp"
+
 namespace otto {
 
+struct PathData;
+
 using glm::vec2;
 using glm::vec3;
 using glm::vec4;
@@ -36,6 +42,18 @@ struct Rect {
   float getArea() const { return size.x * size.y; }
 };
 
+enum StyleFlags {
+  STYLE_FILL_PAINT      = 1 << 0,
+  STYLE_STROKE_PAINT    = 1 << 1,
+  STYLE_STROKE          = 1 << 2, // Width, cap and join
+  STYLE_FILL_RULE       = 1 << 3,
+  STYLE_COLOR_TRANSFORM = 1 << 4, // Values and enabled flag
+  STYLE_MASK            = 1 << 5, // Masking enabled flag and mask operation
+
+  STYLE_ALL = STYLE_FILL_PAINT | STYLE_STROKE_PAINT | STYLE_STROKE | STYLE_FILL_RULE |
+              STYLE_COLOR_TRANSFORM | STYLE_MASK
+};
+
 using Svg = NSVGimage;
 
 vec3 colorBGR(uint32_t color);
@@ -43,6 +61,26 @@ vec3 colorBGR(uint32_t color);
 void strokePaint(const NSVGpaint &svgPaint, float opacity = 1.0f);
 void fillPaint(const NSVGpaint &svgPaint, float opacity = 1.0f);
 
+// Solid colors are quantized to 8 bits per channel and served from a bounded LRU cache of paints, so
+// repeated colors reuse a live VGPaint instead of creating one per call.
+struct PaintCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t size = 0;
+  size_t capacity = 0;
+
+  float getHitRate() const {
+    auto lookups = hits + misses;
+    return lookups ? static_cast<float>(hits) / lookups : 0.0f;
+  }
+};
+
+void setPaintCacheCapacity(size_t capacity);
+void clearPaintCache();
+PaintCacheStats getPaintCacheStats();
+void resetPaintCacheStats();
+
 void strokeColor(float r, float g, float b, float a = 1.0f);
 void strokeColor(const vec4 &color);
 void strokeColor(const vec3 &color);
@@ -52,9 +90,48 @@ void fillColor(const vec4 &color);
 void fillColor(const vec3 &color);
 void fillColor(uint32_t color);
 
+// OpenVG state set through this API is shadowed on the CPU: setters only reach OpenVG when the
+// value changes and getters never read back from the driver. Call invalidateRenderState() after
+// changing state with raw vgSet* calls or after recreating the OpenVG context.
+void invalidateRenderState();
+
+struct GradientStop {
+  float offset;
+  vec4 color;
+};
+
+// Gradient paints are cached by geometry, stops and spread mode, so a gradient that is used every
+// frame only has its color ramp built once.
+void fillLinearGradient(const vec2 &start, const vec2 &end, const GradientStop *stops,
+                        size_t numStops,
+                        VGColorRampSpreadMode spread = VG_COLOR_RAMP_SPREAD_PAD);
+void fillRadialGradient(const vec2 &center, const vec2 &focus, float radius,
+                        const GradientStop *stops, size_t numStops,
+                        VGColorRampSpreadMode spread = VG_COLOR_RAMP_SPREAD_PAD);
+void fillRadialGradient(const vec2 &center, float radius, const GradientStop *stops,
+                        size_t numStops,
+                        VGColorRampSpreadMode spread = VG_COLOR_RAMP_SPREAD_PAD);
+void strokeLinearGradient(const vec2 &start, const vec2 &end, const GradientStop *stops,
+                          size_t numStops,
+                          VGColorRampSpreadMode spread = VG_COLOR_RAMP_SPREAD_PAD);
+void strokeRadialGradient(const vec2 &center, const vec2 &focus, float radius,
+                          const GradientStop *stops, size_t numStops,
+                          VGColorRampSpreadMode spread = VG_COLOR_RAMP_SPREAD_PAD);
+void strokeRadialGradient(const vec2 &center, float radius, const GradientStop *stops,
+                          size_t numStops,
+                          VGColorRampSpreadMode spread = VG_COLOR_RAMP_SPREAD_PAD);
+
+void setGradientCacheCapacity(size_t capacity);
+void clearGradientCache();
+PaintCacheStats getGradientCacheStats();
+void resetGradientCacheStats();
+
 void strokeWidth(VGfloat width);
 void strokeCap(VGCapStyle cap);
 void strokeJoin(VGJoinStyle join);
+VGfloat getStrokeWidth();
+VGCapStyle getStrokeCap();
+VGJoinStyle getStrokeJoin();
 
 void moveTo(VGPath path, float x, float y);
 void lineTo(VGPath path, float x, float y);
@@ -64,6 +141,10 @@ void circle(VGPath path, float x, float y, float radius);
 void ellipse(VGPath path, float x, float y, float rx, float ry);
 void rect(VGPath path, float x, float y, float width, float height);
 void roundRect(VGPath path, float x, float y, float width, float height, float radius);
+void polyline(VGPath path, const vec2 *pts, size_t count);
+void polyline(VGPath path, const float *samples, size_t count, size_t stride, float x, float dx,
+              float y = 0.0f, float yScale = 1.0f);
+void polygon(VGPath path, const vec2 *pts, size_t count);
 
 void beginPath();
 
@@ -86,10 +167,89 @@ void roundRect(float x, float y, float width, float height, float radius);
 void roundRect(const vec2 &pos, const vec2 &size, float radius);
 void roundRect(const Rect &r, float radius);
 
+// Appends a whole batch of points at once. The sample variant places point i at
+// (x + i * dx, y + samples[i * stride] * yScale), so it can read one channel of an interleaved
+// audio buffer directly. polygon() closes the outline.
+void polyline(const vec2 *pts, size_t count);
+void polyline(const float *samples, size_t count, size_t stride, float x, float dx,
+              float y = 0.0f, float yScale = 1.0f);
+void polygon(const vec2 *pts, size_t count);
+
+// Appends the min/max envelope of a sample buffer as one closed outline, one column per
+// `columnWidth` user units across `bounds`, or per device pixel under the current transform by
+// default. Samples of -1 and 1 map to the bottom and top edges of `bounds`. Each column reaches to
+// the first sample of the next, and is at least a pixel thick, so the outline stays connected when
+// zoomed in and flat or silent buffers still show a line.
+// Min/max summaries of each buffer are cached by its address and length so zooming and scrolling
+// through [first, first + visibleCount) doesn't rescan it; call invalidateWaveform() after changing
+// the samples of a buffer that was drawn before.
+void waveform(const float *samples, size_t count, const Rect &bounds, float columnWidth = 0.0f);
+void waveform(const float *samples, size_t count, const Rect &bounds, size_t first,
+              size_t visibleCount, float columnWidth = 0.0f);
+void invalidateWaveform(const float *samples);
+void clearWaveformCache();
+
+// Fill a whole batch of shapes in one color with a single draw, leaving the scratch path, fill
+// paint and fill rule untouched. Overlapping shapes merge.
+void fillRects(const Rect *rects, size_t count, uint32_t color);
+void fillRects(const Rect *rects, size_t count, const vec4 &color);
+void fillCircles(const vec2 *centers, const float *radii, size_t count, uint32_t color);
+void fillCircles(const vec2 *centers, const float *radii, size_t count, const vec4 &color);
+
+// The geometry cache keeps scratch paths that are drawn again in a later frame as retained paths,
+// found by hashing their segments and coordinates, so unchanged immediate-mode geometry isn't
+// uploaded every frame. Hits are checked against a copy of the geometry, which counts towards the
+// byte budget; least recently drawn paths are dropped to stay within it.
+struct GeometryCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t size = 0;
+  size_t bytes = 0;
+  size_t budget = 0;
+
+  float getHitRate() const {
+    auto lookups = hits + misses;
+    return lookups ? static_cast<float>(hits) / lookups : 0.0f;
+  }
+};
+
+void enableGeometryCache();
+void disableGeometryCache();
+void setGeometryCacheBudget(size_t bytes);
+void clearGeometryCache();
+GeometryCacheStats getGeometryCacheStats();
+void resetGeometryCacheStats();
+
+// The stroke cache draws strokes of retained paths and SVG shapes as fills of outlines built on
+// the CPU, keyed by the path, the stroke width, cap and join and the scale of the transform. Like
+// the geometry cache, outlines are only built for strokes drawn a second time.
+void enableStrokeCache();
+void disableStrokeCache();
+void setStrokeCacheBudget(size_t bytes);
+void clearStrokeCache();
+GeometryCacheStats getStrokeCacheStats();
+void resetStrokeCacheStats();
+
+// With coalescing enabled, consecutive fill()/stroke() calls on the scratch path that share the
+// same state and are at least a pixel apart are merged into one draw. Pending draws go out before
+// any state change, other drawing or masking; call flushDraws() before presenting a frame.
+void enableDrawCoalescing();
+void disableDrawCoalescing();
+void flushDraws();
+
+void fillRule(VGFillRule rule);
 void fillRuleEvenOdd();
 void fillRuleNonZero();
 VGFillRule getFillRule();
 
+// Draws whose paints are fully opaque, with masking and color transforms disabled, are blended with
+// VG_BLEND_SRC instead of VG_BLEND_SRC_OVER when the requested blend mode is SRC_OVER.
+void blendMode(VGBlendMode mode);
+VGBlendMode getBlendMode();
+void enableOpaqueFastPath();
+void disableOpaqueFastPath();
+
 void fill();
 void stroke();
 void fillAndStroke();
@@ -104,6 +264,20 @@ void clear(const Rect &rect);
 void drawSvg(const Svg &svg, bool flipY = true);
 void drawSvg(const Svg *svg, bool flipY = true);
 
+// SVG shapes are uploaded as 8 or 16 bit coordinates when that keeps every point within
+// `tolerance` SVG units of where it should be. Pass 0 to always use floats. Defaults to 1/64.
+void svgTolerance(float tolerance);
+float getSvgTolerance();
+
+// The color transform is kept on the CPU and only sent to OpenVG for draws that need it.
+// pushColorTransform() composes with the current transform, so nested fades multiply. With folding
+// enabled, solid fill and stroke colors have the transform applied when they are set and OpenVG's
+// color transform stage is only enabled for gradients.
+void pushColorTransform(const vec4 &scale, const vec4 &bias);
+void popColorTransform();
+void enableColorTransformFolding();
+void disableColorTransformFolding();
+
 void setColorTransform(float sr, float sg, float sb, float sa,
                        float br, float bg, float bb, float ba);
 void setColorTransform(const vec4 &scale, const vec4 &bias);
@@ -119,6 +293,7 @@ void beginMask();
 void endMask();
 void enableMask();
 void disableMask();
+bool getMaskEnabled();
 void fillMask(int x, int y, int width, int height);
 void fillMask(const vec2 &pos, const vec2 &size);
 void fillMask(const Rect &rect);
@@ -127,6 +302,21 @@ void clearMask(const vec2 &pos, const vec2 &size);
 void clearMask(const Rect &rect);
 void maskOperation(VGMaskOperation operation);
 
+// Saves the selected parts of the render state from the CPU-side copy. Fields that were never set
+// through this API are read back from OpenVG once. popStyle() only sends the fields that differ
+// from the current state.
+void pushStyle(uint32_t flags = STYLE_ALL);
+void popStyle();
+
+// Transform operations only update the CPU-side stack; the matrix is uploaded once, right before the
+// next draw that uses it. The stack holds 64 transforms; further pushes are ignored along with
+// their pops and counted in `overflows`, so transforms applied inside them aren't undone.
+struct TransformStats {
+  uint64_t uploads = 0;
+  uint64_t uploadsAvoided = 0;
+  uint64_t overflows = 0;
+};
+
 void pushTransform();
 void popTransform();
 void setTransform(const mat3 &xf);
@@ -140,7 +330,21 @@ void scale(const vec2 &vec);
 void scale(float x, float y);
 void scale(float s);
 
+TransformStats getTransformStats();
+void resetTransformStats();
+
 Svg *loadSvg(const std::string &path, const std::string &units = "px", float dpi = 96);
+
+struct SimplifyStats {
+  size_t segmentsBefore = 0;
+  size_t segmentsAfter = 0;
+};
+
+// Reduces the segment count of shapes exported with far more segments than they need, moving the
+// outline by at most `tolerance`. Nearly straight runs become lines, runs of cubics that a single
+// cubic follows are merged, and segments smaller than `tolerance` are dropped. Meant to be called
+// once after loading.
+SimplifyStats simplifySvg(Svg &svg, float tolerance);
 void loadFont(const std::string &path);
 
 void fontSize(float size);
@@ -160,6 +364,257 @@ protected:
   Noncopyable &operator=(const Noncopyable &) = delete;
 };
 
+// A retained path for geometry that is built once and drawn many times. It has the same builder
+// methods as the scratch path; fill()/stroke() draw it with the current state and honor mask mode.
+// The segments are kept on the CPU as well, and appended to the VGPath in one call when it is next
+// drawn.
+class Path : private Noncopyable {
+public:
+  Path();
+  Path(Path &&other);
+  Path &operator=(Path &&other);
+  ~Path();
+
+  void clear();
+
+  void moveTo(float x, float y);
+  void moveTo(const vec2 &pos);
+  void lineTo(float x, float y);
+  void lineTo(const vec2 &pos);
+  void cubicTo(float x1, float y1, float x2, float y2, float x3, float y3);
+  void cubicTo(const vec2 &p1, const vec2 &p2, const vec2 &p3);
+  void arc(float cx, float cy, float w, float h, float angleStart, float angleEnd);
+  void arc(const vec2 &ctr, const vec2 &size, float angleStart, float angleEnd);
+  void circle(float cx, float cy, float radius);
+  void circle(const vec2 &ctr, float radius);
+  void ellipse(float cx, float cy, float rx, float ry);
+  void ellipse(const vec2 &ctr, const vec2 &radius);
+  void rect(float x, float y, float width, float height);
+  void rect(const vec2 &pos, const vec2 &size);
+  void rect(const Rect &r);
+  void roundRect(float x, float y, float width, float height, float radius);
+  void roundRect(const vec2 &pos, const vec2 &size, float radius);
+  void roundRect(const Rect &r, float radius);
+  void polyline(const vec2 *pts, size_t count);
+  void polyline(const float *samples, size_t count, size_t stride, float x, float dx,
+                float y = 0.0f, float yScale = 1.0f);
+  void polygon(const vec2 *pts, size_t count);
+  void append(const PathData &other);
+  // See simplifySvg()
+  SimplifyStats simplify(float tolerance);
+
+  // Appends segments added since the last call. Returns VG_INVALID_HANDLE for an empty path.
+  VGPath getHandle() const;
+  const PathData &getData() const { return *data; }
+  // Hash of the path data, recomputed only after the path changes
+  uint64_t getHash() const;
+
+private:
+  void modified();
+
+  std::unique_ptr<PathData> data;
+  mutable VGPath handle = VG_INVALID_HANDLE;
+  mutable size_t uploadedSegments = 0, uploadedCoords = 0;
+  mutable uint64_t hash = 0;
+  mutable bool hashValid = false;
+};
+
+void fill(const Path &path);
+void stroke(const Path &path);
+void fillAndStroke(const Path &path);
+
+// Returns a path covering the result of `op` on the areas `a` and `b` fill with `fillRule`, e.g.
+// a shape with a cut-out that would otherwise be drawn through a mask. The result is made of
+// polygons with curves flattened to within `tolerance`. The work grows with the square of the
+// number of edges, so combine paths up front rather than every frame. If the outline of the result
+// can't be traced, which takes degenerate input, the returned path is empty.
+Path combinePaths(const Path &a, const Path &b, PathOp op, VGFillRule fillRule = VG_NON_ZERO,
+                  float tolerance = 0.25f);
+
+// A retained path for animated shapes whose segments stay the same from frame to frame. The
+// geometry is rebuilt between begin() and end() with the usual builders; when the segments match
+// the previous build only the coordinates are rewritten with vgModifyPathCoords. Arcs always use
+// at least four cubics so their sweep can change without changing the segments.
+//
+// In ring mode the path is a polyline of a fixed number of points spaced `dx` apart, fed with
+// pushSamples() like a scrolling oscilloscope trace. The newest sample is at the right.
+class DynamicPath : private Noncopyable {
+public:
+  DynamicPath();
+  DynamicPath(DynamicPath &&other);
+  DynamicPath &operator=(DynamicPath &&other);
+  ~DynamicPath();
+
+  void begin();
+  void end();
+
+  void moveTo(float x, float y);
+  void moveTo(const vec2 &pos);
+  void lineTo(float x, float y);
+  void lineTo(const vec2 &pos);
+  void cubicTo(float x1, float y1, float x2, float y2, float x3, float y3);
+  void cubicTo(const vec2 &p1, const vec2 &p2, const vec2 &p3);
+  void arc(float cx, float cy, float w, float h, float angleStart, float angleEnd);
+  void arc(const vec2 &ctr, const vec2 &size, float angleStart, float angleEnd);
+  void polyline(const vec2 *pts, size_t count);
+  void polyline(const float *samples, size_t count, size_t stride, float x, float dx,
+                float y = 0.0f, float yScale = 1.0f);
+  void close();
+
+  // Point i of the trace is drawn at (x + i * dx, y + sample * yScale). All samples start at zero.
+  void beginRing(size_t numPoints, float x, float dx, float y = 0.0f, float yScale = 1.0f);
+  void pushSamples(const float *samples, size_t count, size_t stride = 1);
+
+  // Uploads pending ring samples
+  VGPath getHandle() const;
+
+private:
+  std::unique_ptr<PathData> data;
+  std::vector<VGubyte> uploadedSegments;
+  VGPath handle = VG_INVALID_HANDLE;
+
+  std::vector<float> ring;
+  size_t ringHead = 0;
+  float ringY = 0.0f, ringYScale = 1.0f;
+  mutable bool ringDirty = false;
+};
+
+void fill(const DynamicPath &path);
+void stroke(const DynamicPath &path);
+void fillAndStroke(const DynamicPath &path);
+
+// Flattens a path once into a polyline with cumulative arc lengths, so the length of the path and
+// positions and tangents along it can be looked up in O(log n) without going back to OpenVG.
+// Distances are clamped to [0, getLength()] and don't count the gaps between subpaths.
+class PathMeasure {
+public:
+  // Flattened points stay within `tolerance` of the curves they replace
+  explicit PathMeasure(float tolerance = 0.25f);
+
+  void setPath(const NSVGshape &shape);
+  void setPath(const PathData &data);
+  // Measures the CPU-side copy of the path, so the VGPath isn't needed
+  void setPath(const Path &path);
+  // OpenVG can't export path data, so the path is sampled once with vgPointAlongPath. It needs
+  // the PATH_LENGTH, POINT_ALONG_PATH and TANGENT_ALONG_PATH capabilities, which paths created by
+  // this library don't have; without them this returns false and the measure is left empty.
+  bool setPath(VGPath path);
+
+  float getLength() const;
+  vec2 getPosition(float distance) const;
+  vec2 getTangent(float distance) const;
+
+  // Rebuilds `out` as the part of the path between the two distances. Points outside the range
+  // collapse onto its ends, so while the same subpaths are visible only the coordinates of `out`
+  // change and it is updated in place.
+  void trimPath(float start, float end, DynamicPath &out) const;
+
+private:
+  void beginSubpath(const vec2 &p);
+  void endSubpath();
+  void addPoint(const vec2 &p);
+  size_t findSegment(float distance, size_t first, size_t last) const;
+  vec2 getPosition(float distance, size_t first, size_t last) const;
+
+  float tolerance;
+  std::vector<vec2> points;
+  std::vector<float> distances;
+  // Index of the first point of each subpath
+  std::vector<size_t> subpaths;
+};
+
+// Morphs between two SVG shapes with vgInterpolatePath. Shapes whose segments don't line up are
+// made to match once up front: missing subpaths grow from the center of their counterpart and
+// cubics are split until both sides have the same number. morph() then costs one interpolation
+// into a preallocated path, or a CPU blend and vgModifyPathCoords if the driver refuses to
+// interpolate.
+class PathMorph : private Noncopyable {
+public:
+  PathMorph() = default;
+  PathMorph(const NSVGshape &from, const NSVGshape &to);
+  PathMorph(PathMorph &&other);
+  PathMorph &operator=(PathMorph &&other);
+  ~PathMorph();
+
+  void setPaths(const NSVGshape &from, const NSVGshape &to);
+  void morph(float t);
+
+  VGPath getHandle() const { return target; }
+
+private:
+  void destroy();
+
+  VGPath from = VG_INVALID_HANDLE;
+  VGPath to = VG_INVALID_HANDLE;
+  VGPath target = VG_INVALID_HANDLE;
+  std::vector<VGubyte> segments;
+  std::vector<VGfloat> fromCoords, toCoords, coords;
+  bool blendOnCpu = false;
+};
+
+void fill(const PathMorph &morph);
+void stroke(const PathMorph &morph);
+void fillAndStroke(const PathMorph &morph);
+
+// Draws `path` once per transform, each applied on top of the current transform. If `colors` is
+// given (packed like fillColor(uint32_t)), each instance is drawn with its color for the paint
+// modes being drawn and the previous paints are restored afterwards. Instances are grouped by
+// color, so the draw order between differently colored instances is not preserved.
+void drawInstances(VGPath path, const mat3 *xforms, const uint32_t *colors, size_t count,
+                   VGbitfield paintModes = VG_FILL_PATH);
+void drawInstances(const Path &path, const mat3 *xforms, const uint32_t *colors, size_t count,
+                   VGbitfield paintModes = VG_FILL_PATH);
+
+// An Svg turned into retained OpenVG objects: a VGPath per shape, stored as compactly as
+// svgTolerance() allows, each shape's stroke parameters and its gradient paints, which are owned
+// by the CompiledSvg rather than the gradient cache. Solid colors are looked up in the paint
+// cache when drawn so color transforms still apply to them.
+class CompiledSvg : private Noncopyable {
+public:
+  struct Paint {
+    // Gradient paint, or VG_INVALID_HANDLE for a solid color
+    VGPaint paint = VG_INVALID_HANDLE;
+    uint32_t rgba = 0;
+    bool opaque = true;
+    mat3 paintToUser;
+  };
+
+  struct Shape {
+    VGPath path = VG_INVALID_HANDLE;
+    VGbitfield paintModes = 0;
+    Paint fill, stroke;
+    float strokeWidth = 1.0f;
+    VGCapStyle strokeCap = VG_CAP_BUTT;
+    VGJoinStyle strokeJoin = VG_JOIN_MITER;
+  };
+
+  CompiledSvg() = default;
+  explicit CompiledSvg(const Svg &svg);
+  CompiledSvg(CompiledSvg &&other);
+  CompiledSvg &operator=(CompiledSvg &&other);
+  ~CompiledSvg();
+
+  const std::vector<Shape> &getShapes() const { return shapes; }
+  float getWidth() const { return width; }
+  float getHeight() const { return height; }
+
+private:
+  void destroy();
+
+  std::vector<Shape> shapes;
+  float width = 0.0f, height = 0.0f;
+};
+
+// Compiles `svg` so drawing it only sets state and calls vgDrawPath, with no geometry uploaded per
+// frame. The Svg is not referenced afterwards.
+CompiledSvg compileSvg(const Svg &svg);
+void drawSvg(const CompiledSvg &svg, bool flipY = true);
+
+struct ScopedStyle : private Noncopyable {
+  ScopedStyle(uint32_t flags = STYLE_ALL) { pushStyle(flags); }
+  ~ScopedStyle() { popStyle(); }
+};
+
 struct ScopedTransform : private Noncopyable {
   ScopedTransform() { pushTransform(); }
   ~ScopedTransform() { popTransform(); }
@@ -172,18 +627,14 @@ struct ScopedMask : private Noncopyable {
 };
 
 struct ScopedFillRule : private Noncopyable {
-  VGFillRule prevFillRule;
-
-  ScopedFillRule(VGFillRule fillRule) : prevFillRule{ getFillRule() } {
-    vgSeti(VG_FILL_RULE, fillRule);
+  ScopedFillRule(VGFillRule rule) {
+    pushStyle(STYLE_FILL_RULE);
+    fillRule(rule);
   }
-  ~ScopedFillRule() { vgSeti(VG_FILL_RULE, prevFillRule); }
+  ~ScopedFillRule() { popStyle(); }
 };
 
 struct ScopedColorTransform : private Noncopyable {
-  std::pair<vec4, vec4> prevColorTransform;
-  bool prevColorTransformEnabled;
-
   ScopedColorTransform(float sr, float sg, float sb, float sa,
                        float br, float bg, float bb, float ba);
   ScopedColorTransform(const vec4 &scale, const vec4 &bias);
@@ -0,0 +1,508 @@
+#include "path_data.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <cstdint>
+
+namespace otto {
+
+void PathData::moveTo(float x, float y) {
+  segments.push_back(VG_MOVE_TO_ABS);
+  coords.push_back(x);
+  coords.push_back(y);
+}
+
+void PathData::lineTo(float x, float y) {
+  segments.push_back(VG_LINE_TO_ABS);
+  coords.push_back(x);
+  coords.push_back(y);
+}
+
+void PathData::quadTo(float x1, float y1, float x2, float y2) {
+  segments.push_back(VG_QUAD_TO | VG_ABSOLUTE);
+  VGfloat c[] = { x1, y1, x2, y2 };
+  coords.insert(coords.end(), c, c + 4);
+}
+
+void PathData::cubicTo(float x1, float y1, float x2, float y2, float x3, float y3) {
+  segments.push_back(VG_CUBIC_TO_ABS);
+  VGfloat c[] = { x1, y1, x2, y2, x3, y3 };
+  coords.insert(coords.end(), c, c + 6);
+}
+
+void PathData::close() {
+  segments.push_back(VG_CLOSE_PATH);
+}
+
+// Appends cubics approximating the elliptical arc around (cx, cy) from angle a0 to a1, split into
+// pieces of at most 90 degrees. The error of each piece is below 0.03% of the radius.
+static void appendArcCubics(PathData &data, float cx, float cy, float rx, float ry, float a0,
+                            float a1, int minPieces = 1) {
+  int numPieces = std::max(minPieces, static_cast<int>(ceilf(fabsf(a1 - a0) / (float(M_PI) * 0.5f) - 1e-4f)));
+  float step = (a1 - a0) / numPieces;
+  float k = 4.0f / 3.0f * tanf(step * 0.25f);
+
+  float c0 = cosf(a0), s0 = sinf(a0);
+  for (int i = 1; i <= numPieces; ++i) {
+    float a = (i == numPieces) ? a1 : a0 + step * i;
+    float c1 = cosf(a), s1 = sinf(a);
+    data.cubicTo(cx + rx * (c0 - k * s0), cy + ry * (s0 + k * c0),
+                 cx + rx * (c1 + k * s1), cy + ry * (s1 - k * c1),
+                 cx + rx * c1, cy + ry * s1);
+    c0 = c1;
+    s0 = s1;
+  }
+}
+
+void PathData::arc(float cx, float cy, float w, float h, float angleStart, float angleEnd,
+                   int minPieces) {
+  if (w <= 0.0f || h <= 0.0f) return;
+  float rx = w * 0.5f, ry = h * 0.5f;
+  moveTo(cx + rx * cosf(angleStart), cy + ry * sinf(angleStart));
+  appendArcCubics(*this, cx, cy, rx, ry, angleStart, angleEnd, minPieces);
+}
+
+void PathData::ellipse(float cx, float cy, float rx, float ry) {
+  if (rx <= 0.0f || ry <= 0.0f) return;
+  moveTo(cx + rx, cy);
+  appendArcCubics(*this, cx, cy, rx, ry, 0.0f, 2.0f * float(M_PI));
+  close();
+}
+
+void PathData::rect(float x, float y, float width, float height) {
+  if (width <= 0.0f || height <= 0.0f) return;
+  moveTo(x, y);
+  lineTo(x + width, y);
+  lineTo(x + width, y + height);
+  lineTo(x, y + height);
+  close();
+}
+
+void PathData::roundRect(float x, float y, float width, float height, float radius) {
+  roundRect(x, y, width, height, radius, radius);
+}
+
+void PathData::roundRect(float x, float y, float width, float height, float rx, float ry) {
+  if (width <= 0.0f || height <= 0.0f) return;
+  rx = std::min(std::max(rx, 0.0f), width * 0.5f);
+  ry = std::min(std::max(ry, 0.0f), height * 0.5f);
+  if (rx == 0.0f || ry == 0.0f) {
+    rect(x, y, width, height);
+    return;
+  }
+
+  const float hp = float(M_PI) * 0.5f;
+  float x0 = x + rx, x1 = x + width - rx;
+  float y0 = y + ry, y1 = y + height - ry;
+
+  moveTo(x0, y);
+  lineTo(x1, y);
+  appendArcCubics(*this, x1, y0, rx, ry, -hp, 0.0f);
+  lineTo(x + width, y1);
+  appendArcCubics(*this, x1, y1, rx, ry, 0.0f, hp);
+  lineTo(x0, y + height);
+  appendArcCubics(*this, x0, y1, rx, ry, hp, 2.0f * hp);
+  lineTo(x, y0);
+  appendArcCubics(*this, x0, y0, rx, ry, 2.0f * hp, 3.0f * hp);
+  close();
+}
+
+void PathData::polyline(const glm::vec2 *pts, size_t count, bool close) {
+  if (count == 0) return;
+  segments.push_back(VG_MOVE_TO_ABS);
+  segments.insert(segments.end(), count - 1, VG_LINE_TO_ABS);
+  if (close) segments.push_back(VG_CLOSE_PATH);
+
+  auto src = reinterpret_cast<const VGfloat *>(pts);
+  coords.insert(coords.end(), src, src + count * 2);
+}
+
+void PathData::polyline(const float *samples, size_t count, size_t stride, float x, float dx,
+                        float y, float yScale, bool close) {
+  if (count == 0) return;
+  segments.push_back(VG_MOVE_TO_ABS);
+  segments.insert(segments.end(), count - 1, VG_LINE_TO_ABS);
+  if (close) segments.push_back(VG_CLOSE_PATH);
+
+  size_t first = coords.size();
+  coords.resize(first + count * 2);
+  VGfloat *dst = coords.data() + first;
+  for (size_t i = 0; i < count; ++i) {
+    dst[i * 2] = x + dx * i;
+    dst[i * 2 + 1] = y + samples[i * stride] * yScale;
+  }
+}
+
+int getFlatteningSteps(float dd, int degree, float tolerance) {
+  float steps = sqrtf(degree * (degree - 1) * 0.125f * dd / tolerance);
+  return std::min(std::max(static_cast<int>(ceilf(steps)), 1), 256);
+}
+
+void PathData::flatten(float tolerance, std::vector<Polyline> &out) const {
+  using glm::vec2;
+
+  Polyline *current = nullptr;
+  vec2 start, pos;
+  // After a close the next segment starts a new subpath at the same point
+  auto continueSubpath = [&]() {
+    if (current == nullptr) {
+      out.emplace_back();
+      current = &out.back();
+      current->points.push_back(pos);
+    }
+  };
+  auto endSubpath = [&]() {
+    if (current != nullptr && current->points.size() < 2) out.pop_back();
+    current = nullptr;
+  };
+
+  const VGfloat *c = coords.data();
+  for (auto segment : segments) {
+    switch (segment & ~VG_RELATIVE) {
+      case VG_MOVE_TO:
+        endSubpath();
+        start = pos = vec2(c[0], c[1]);
+        c += 2;
+        break;
+      case VG_LINE_TO:
+        continueSubpath();
+        pos = vec2(c[0], c[1]);
+        current->points.push_back(pos);
+        c += 2;
+        break;
+      case VG_QUAD_TO: {
+        continueSubpath();
+        vec2 p0 = pos, p1(c[0], c[1]), p2(c[2], c[3]);
+        int steps = getFlatteningSteps(glm::length(p0 - 2.0f * p1 + p2), 2, tolerance);
+        for (int k = 1; k <= steps; ++k) {
+          float t = static_cast<float>(k) / steps, u = 1.0f - t;
+          current->points.push_back(u * u * p0 + 2.0f * u * t * p1 + t * t * p2);
+        }
+        pos = p2;
+        c += 4;
+        break;
+      }
+      case VG_CUBIC_TO: {
+        continueSubpath();
+        vec2 p0 = pos, p1(c[0], c[1]), p2(c[2], c[3]), p3(c[4], c[5]);
+        float dd = std::max(glm::length(p0 - 2.0f * p1 + p2), glm::length(p1 - 2.0f * p2 + p3));
+        int steps = getFlatteningSteps(dd, 3, tolerance);
+        for (int k = 1; k <= steps; ++k) {
+          float t = static_cast<float>(k) / steps, u = 1.0f - t;
+          current->points.push_back(u * u * u * p0 + 3.0f * u * u * t * p1 +
+                                    3.0f * u * t * t * p2 + t * t * t * p3);
+        }
+        pos = p3;
+        c += 6;
+        break;
+      }
+      case VG_CLOSE_PATH:
+        if (current != nullptr) current->closed = true;
+        endSubpath();
+        pos = start;
+        break;
+    }
+  }
+  endSubpath();
+}
+
+namespace {
+
+struct Cubic {
+  glm::vec2 p[4];
+};
+
+// Collects simplified segments of one subpath at a time. Consecutive segments are gathered in a
+// run that is either all nearly straight or all curved, and written out as one line or one cubic
+// once the next segment no longer fits.
+class Simplifier {
+public:
+  Simplifier(float tolerance, PathData &out) : tolerance{ tolerance }, out(out) {}
+
+  void moveTo(const glm::vec2 &p) {
+    flush();
+    out.moveTo(p.x, p.y);
+    start = end = p;
+    hasSegments = false;
+  }
+
+  void add(Cubic c);
+
+  void close() {
+    flush();
+    out.close();
+    end = start;
+  }
+
+  void flush();
+
+private:
+  bool isStraight(const Cubic &c) const;
+  bool extendLine(const Cubic &c) const;
+  bool extendCurve(const Cubic &c);
+
+  // Longer runs would make the checks quadratic for little gain
+  static const size_t MAX_LINE_RUN = 256;
+  static const size_t MAX_CURVE_RUN = 16;
+
+  float tolerance;
+  PathData &out;
+  glm::vec2 start, end;
+  bool hasSegments = false;
+
+  std::vector<Cubic> run;
+  bool runIsLine = false;
+  // The cubic standing in for a curved run
+  Cubic merged;
+};
+
+} // namespace
+
+static float distanceToSegment(const glm::vec2 &p, const glm::vec2 &a, const glm::vec2 &b) {
+  glm::vec2 ab = b - a;
+  float len2 = glm::dot(ab, ab);
+  float t = len2 > 0.0f ? std::min(std::max(glm::dot(p - a, ab) / len2, 0.0f), 1.0f) : 0.0f;
+  return glm::length(p - (a + ab * t));
+}
+
+static glm::vec2 evalCubic(const Cubic &c, float t) {
+  float u = 1.0f - t;
+  return u * u * u * c.p[0] + 3.0f * u * u * t * c.p[1] + 3.0f * u * t * t * c.p[2] +
+         t * t * t * c.p[3];
+}
+
+static float getControlLength(const Cubic &c) {
+  return glm::length(c.p[1] - c.p[0]) + glm::length(c.p[2] - c.p[1]) +
+         glm::length(c.p[3] - c.p[2]);
+}
+
+bool Simplifier::isStraight(const Cubic &c) const {
+  return distanceToSegment(c.p[1], c.p[0], c.p[3]) <= tolerance &&
+         distanceToSegment(c.p[2], c.p[0], c.p[3]) <= tolerance;
+}
+
+bool Simplifier::extendLine(const Cubic &c) const {
+  if (run.size() >= MAX_LINE_RUN) return false;
+  auto a = run[0].p[0], b = c.p[3];
+  for (int i = 1; i < 4; ++i) {
+    if (distanceToSegment(c.p[i], a, b) > tolerance) return false;
+  }
+  for (const auto &r : run) {
+    for (int i = 1; i < 4; ++i) {
+      if (distanceToSegment(r.p[i], a, b) > tolerance) return false;
+    }
+  }
+  return true;
+}
+
+// A cubic split in two has pieces whose outer control points lie along its own, scaled by the
+// share of the curve each piece covers. The merge guesses those shares from the control polygon
+// lengths and checks that the candidate passes near points sampled along every original piece.
+bool Simplifier::extendCurve(const Cubic &c) {
+  if (run.size() >= MAX_CURVE_RUN) return false;
+
+  // The curves have to meet smoothly
+  const auto &last = run.back();
+  auto tin = last.p[3] - last.p[2], tout = c.p[1] - c.p[0];
+  float lin = glm::length(tin), lout = glm::length(tout);
+  if (lin == 0.0f || lout == 0.0f || glm::dot(tin, tout) <= 0.0f ||
+      fabsf(tin.x * tout.y - tin.y * tout.x) > 0.05f * lin * lout) {
+    return false;
+  }
+
+  float total = getControlLength(c);
+  for (const auto &r : run) total += getControlLength(r);
+  float first = getControlLength(run[0]), lastLength = getControlLength(c);
+  if (first == 0.0f || lastLength == 0.0f) return false;
+
+  Cubic candidate;
+  candidate.p[0] = run[0].p[0];
+  candidate.p[1] = run[0].p[0] + (run[0].p[1] - run[0].p[0]) * (total / first);
+  candidate.p[2] = c.p[3] + (c.p[2] - c.p[3]) * (total / lastLength);
+  candidate.p[3] = c.p[3];
+
+  float t0 = 0.0f;
+  for (size_t i = 0; i <= run.size(); ++i) {
+    const auto &piece = i < run.size() ? run[i] : c;
+    float t1 = t0 + getControlLength(piece) / total;
+    for (float s : { 0.25f, 0.5f, 0.75f, 1.0f }) {
+      auto expected = evalCubic(piece, s);
+      if (glm::length(evalCubic(candidate, t0 + (t1 - t0) * s) - expected) > tolerance) return false;
+    }
+    t0 = t1;
+  }
+
+  run.push_back(c);
+  merged = candidate;
+  return true;
+}
+
+void Simplifier::add(Cubic c) {
+  // Dropped segments leave their end behind, so the next one starts where the output ends
+  c.p[0] = end;
+  if (hasSegments && glm::length(c.p[1] - end) <= tolerance &&
+      glm::length(c.p[2] - end) <= tolerance && glm::length(c.p[3] - end) <= tolerance) {
+    return;
+  }
+  hasSegments = true;
+
+  bool straight = isStraight(c);
+  if (!run.empty() && straight == runIsLine && (straight ? extendLine(c) : extendCurve(c))) {
+    if (straight) run.push_back(c);
+    end = c.p[3];
+    return;
+  }
+
+  flush();
+  run.push_back(c);
+  runIsLine = straight;
+  merged = c;
+  end = c.p[3];
+}
+
+void Simplifier::flush() {
+  if (run.empty()) return;
+  if (runIsLine) {
+    out.lineTo(end.x, end.y);
+  }
+  else {
+    out.cubicTo(merged.p[1].x, merged.p[1].y, merged.p[2].x, merged.p[2].y, merged.p[3].x,
+                merged.p[3].y);
+  }
+  run.clear();
+}
+
+// Moving the drawn points by half the tolerance for dropped segments and half for merges keeps the
+// total within it. Lines and quads are handled as cubics.
+void PathData::simplify(float tolerance) {
+  using glm::vec2;
+
+  PathData out;
+  Simplifier simplifier(tolerance * 0.5f, out);
+
+  vec2 start, pos;
+  const VGfloat *c = coords.data();
+  for (auto segment : segments) {
+    switch (segment & ~VG_RELATIVE) {
+      case VG_MOVE_TO:
+        start = pos = vec2(c[0], c[1]);
+        simplifier.moveTo(pos);
+        c += 2;
+        break;
+      case VG_LINE_TO: {
+        vec2 p(c[0], c[1]);
+        simplifier.add({ { pos, pos + (p - pos) / 3.0f, p + (pos - p) / 3.0f, p } });
+        pos = p;
+        c += 2;
+        break;
+      }
+      case VG_QUAD_TO: {
+        vec2 q(c[0], c[1]), p(c[2], c[3]);
+        simplifier.add({ { pos, pos + (q - pos) * (2.0f / 3.0f), p + (q - p) * (2.0f / 3.0f), p } });
+        pos = p;
+        c += 4;
+        break;
+      }
+      case VG_CUBIC_TO: {
+        vec2 p1(c[0], c[1]), p2(c[2], c[3]), p3(c[4], c[5]);
+        simplifier.add({ { pos, p1, p2, p3 } });
+        pos = p3;
+        c += 6;
+        break;
+      }
+      case VG_CLOSE_PATH:
+        simplifier.close();
+        pos = start;
+        break;
+    }
+  }
+  simplifier.flush();
+
+  segments.swap(out.segments);
+  coords.swap(out.coords);
+}
+
+uint64_t PathData::hash() const {
+  uint64_t h = 14695981039346656037ull ^ segments.size();
+  for (auto segment : segments) h = (h ^ segment) * 1099511628211ull;
+  const auto bits = reinterpret_cast<const uint32_t *>(coords.data());
+  for (size_t i = 0; i < coords.size(); ++i) h = (h ^ bits[i]) * 1099511628211ull;
+  return h;
+}
+
+void PathData::appendTo(VGPath path, size_t firstSegment, size_t firstCoord) const {
+  if (firstSegment >= segments.size()) return;
+  vgAppendPathData(path, static_cast<VGint>(segments.size() - firstSegment),
+                   segments.data() + firstSegment, coords.data() + firstCoord);
+}
+
+// Quantizes `coords` into `out` as round((v - bias) / scale). Every coordinate PathData emits is a
+// point, so a single scale and bias cover all of them.
+template <typename T>
+static const T *quantizeCoords(const std::vector<VGfloat> &coords, float scale, float bias,
+                               std::vector<uint8_t> &out) {
+  float invScale = 1.0f / scale;
+  out.resize(coords.size() * sizeof(T));
+  auto quantized = reinterpret_cast<T *>(out.data());
+  for (size_t i = 0; i < coords.size(); ++i) {
+    quantized[i] = static_cast<T>(lrintf((coords[i] - bias) * invScale));
+  }
+  return quantized;
+}
+
+VGPath PathData::createPath(VGbitfield capabilities, float tolerance,
+                            std::vector<uint8_t> *quantized) const {
+  VGPathDatatype datatype = VG_PATH_DATATYPE_F;
+  float scale = 1.0f, bias = 0.0f;
+
+  if (tolerance > 0.0f && !coords.empty()) {
+    auto range = std::minmax_element(coords.begin(), coords.end());
+    float lo = *range.first, hi = *range.second;
+    bias = (lo + hi) * 0.5f;
+
+    // The largest quantized magnitude is (hi - lo) / 2 / scale, which must fit the datatype.
+    // Both coordinates of a point can be off by half a step, so a point moves up to sqrt(2) times
+    // as far.
+    float extent = std::max(hi - lo, 1e-6f);
+    float maxStep = 2.0f * tolerance * float(M_SQRT1_2);
+    if (extent / 254.0f <= maxStep) {
+      datatype = VG_PATH_DATATYPE_S_8;
+      scale = extent / 254.0f;
+    }
+    else if (extent / 65534.0f <= maxStep) {
+      datatype = VG_PATH_DATATYPE_S_16;
+      scale = extent / 65534.0f;
+    }
+    else {
+      bias = 0.0f;
+    }
+  }
+
+  auto numSegments = static_cast<VGint>(segments.size());
+  auto path = vgCreatePath(VG_PATH_FORMAT_STANDARD, datatype, scale, bias, numSegments,
+                           static_cast<VGint>(coords.size()),
+                           capabilities | VG_PATH_CAPABILITY_APPEND_TO);
+
+  std::vector<uint8_t> temp;
+  auto &buffer = quantized ? *quantized : temp;
+  switch (datatype) {
+    case VG_PATH_DATATYPE_S_8:
+      vgAppendPathData(path, numSegments, segments.data(),
+                       quantizeCoords<int8_t>(coords, scale, bias, buffer));
+      break;
+    case VG_PATH_DATATYPE_S_16:
+      vgAppendPathData(path, numSegments, segments.data(),
+                       quantizeCoords<int16_t>(coords, scale, bias, buffer));
+      break;
+    default:
+      vgAppendPathData(path, numSegments, segments.data(), coords.data());
+      break;
+  }
+
+  if (!(capabilities & VG_PATH_CAPABILITY_APPEND_TO)) {
+    vgRemovePathCapabilities(path, VG_PATH_CAPABILITY_APPEND_TO);
+  }
+  return path;
+}
+
+} // otto
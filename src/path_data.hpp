@@ -0,0 +1,81 @@
+#pragma once
+
+#include <VG/openvg.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace otto {
+
+// A subpath flattened to line segments
+struct Polyline {
+  std::vector<glm::vec2> points;
+  bool closed = false;
+};
+
+// Number of lines needed to keep a curve within `tolerance`, after Wang's formula. `dd` is the
+// largest second difference of the control points and `degree` the degree of the curve.
+int getFlatteningSteps(float dd, int degree, float tolerance);
+
+// Path segments and coordinates collected on the CPU so they can be handed to OpenVG with a single
+// vgAppendPathData. Arcs, ellipses and rounded rects are generated as cubic Béziers using the same
+// conventions as their vgu* counterparts.
+struct PathData {
+  std::vector<VGubyte> segments;
+  std::vector<VGfloat> coords;
+
+  void clear() {
+    segments.clear();
+    coords.clear();
+  }
+  bool empty() const { return segments.empty(); }
+
+  void moveTo(float x, float y);
+  void lineTo(float x, float y);
+  void quadTo(float x1, float y1, float x2, float y2);
+  void cubicTo(float x1, float y1, float x2, float y2, float x3, float y3);
+  void close();
+
+  // Angles are in radians, counterclockwise from the positive x axis. Like vguArc with
+  // VGU_ARC_OPEN, the arc starts a new subpath. The arc is split into at least `minPieces` cubics.
+  void arc(float cx, float cy, float w, float h, float angleStart, float angleEnd,
+           int minPieces = 1);
+  void ellipse(float cx, float cy, float rx, float ry);
+  void rect(float x, float y, float width, float height);
+  void roundRect(float x, float y, float width, float height, float radius);
+  void roundRect(float x, float y, float width, float height, float rx, float ry);
+
+  // A moveTo to the first point followed by lineTos to the rest, closed if `close` is set.
+  void polyline(const glm::vec2 *pts, size_t count, bool close = false);
+  // Points at (x + i * dx, y + samples[i * stride] * yScale), e.g. one channel of an interleaved
+  // audio buffer.
+  void polyline(const float *samples, size_t count, size_t stride, float x, float dx, float y,
+                float yScale, bool close = false);
+
+  // Appends each subpath, with curves flattened to lines within `tolerance`, to `out`. Subpaths
+  // without any segments after their moveTo are skipped.
+  void flatten(float tolerance, std::vector<Polyline> &out) const;
+
+  // Rewrites the data with fewer segments while keeping the outline within `tolerance`: runs of
+  // nearly straight segments become single lines, runs of cubics that one cubic can follow are
+  // merged, and segments that don't leave a `tolerance` radius around their start are dropped.
+  void simplify(float tolerance);
+
+  // 64-bit FNV-1a over the segments and the bits of the coordinates
+  uint64_t hash() const;
+
+  // Appends segments starting at `firstSegment` / `firstCoord` to `path` in one call.
+  void appendTo(VGPath path, size_t firstSegment = 0, size_t firstCoord = 0) const;
+
+  // Creates a new path holding the data with only the given capabilities. With a positive
+  // `tolerance` the coordinates are stored as S_8 or S_16 with a scale and bias chosen from their
+  // bounds, using the smallest datatype that keeps every point within `tolerance` of where it was,
+  // and F otherwise. Quantized coordinates are written to `quantized`, which can be reused between
+  // calls; without one a temporary buffer is allocated.
+  VGPath createPath(VGbitfield capabilities, float tolerance = 0.0f,
+                    std::vector<uint8_t> *quantized = nullptr) const;
+};
+
+} // otto
@@ -0,0 +1,443 @@
+#include "path_ops.hpp"
+#include "path_data.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace otto {
+
+using glm::vec2;
+
+// Edges closer than this, relative to their parameter range, are treated as touching
+static const float INTERSECT_EPSILON = 1e-5f;
+// Times the pieces are checked for crossings introduced by moving them onto shared vertices
+static const int MAX_SPLIT_ROUNDS = 4;
+
+namespace {
+
+struct Edge {
+  vec2 a, b;
+  int source; // 0 for edges of the first path, 1 for the second
+};
+
+// A point along an edge at which it is split, with its parameter along the edge
+struct Split {
+  float t;
+  vec2 p;
+  bool operator<(const Split &o) const { return t < o.t; }
+};
+
+// The part of one or more input edges between two vertices, v[0] < v[1]. `delta` is how much the
+// winding number of each path goes up crossing from the right of v[0] -> v[1] to its left.
+struct Piece {
+  uint32_t v[2];
+  int delta[2];
+};
+
+// Every point the result can pass through, with points closer than `distance` joined into one
+// vertex. A crossing is computed separately for each pair of edges that meet there, and the
+// results can differ in the last bits, so they have to be joined for the pieces to link up.
+class VertexTable {
+public:
+  explicit VertexTable(float distance) : distance{ distance } {}
+
+  uint32_t weld(const vec2 &p) {
+    // The same point always gets the same vertex, even if a closer one is added later
+    auto exact = exactIndices.find(pointKey(p));
+    if (exact != exactIndices.end()) return exact->second;
+
+    int64_t cx = cellCoord(p.x), cy = cellCoord(p.y);
+    uint32_t index = static_cast<uint32_t>(vertices.size());
+    float nearest = distance;
+    for (int64_t y = cy - 1; y <= cy + 1; ++y) {
+      for (int64_t x = cx - 1; x <= cx + 1; ++x) {
+        auto range = cells.equal_range(cellKey(x, y));
+        for (auto it = range.first; it != range.second; ++it) {
+          float d = glm::length(vertices[it->second] - p);
+          if (d <= nearest) {
+            nearest = d;
+            index = it->second;
+          }
+        }
+      }
+    }
+    if (index == vertices.size()) {
+      vertices.push_back(p);
+      cells.insert({ cellKey(cx, cy), index });
+    }
+    exactIndices[pointKey(p)] = index;
+    return index;
+  }
+
+  size_t size() const { return vertices.size(); }
+  const vec2 &operator[](uint32_t i) const { return vertices[i]; }
+
+private:
+  static uint64_t pointKey(const vec2 &p) {
+    // Adding zero turns -0 into +0
+    float x = p.x + 0.0f, y = p.y + 0.0f;
+    uint32_t bx, by;
+    memcpy(&bx, &x, sizeof(bx));
+    memcpy(&by, &y, sizeof(by));
+    return (static_cast<uint64_t>(bx) << 32) | by;
+  }
+
+  int64_t cellCoord(float v) const { return static_cast<int64_t>(floorf(v / distance)); }
+  static uint64_t cellKey(int64_t x, int64_t y) {
+    return static_cast<uint64_t>(x) * 1099511628211ull ^ static_cast<uint64_t>(y);
+  }
+
+  float distance;
+  std::vector<vec2> vertices;
+  std::unordered_map<uint64_t, uint32_t> exactIndices;
+  std::unordered_multimap<uint64_t, uint32_t> cells;
+};
+
+} // namespace
+
+static float cross(const vec2 &a, const vec2 &b) {
+  return a.x * b.y - a.y * b.x;
+}
+
+// Every subpath is closed, as it is when filled.
+static void addEdges(const PathData &data, int source, float tolerance, std::vector<Edge> &edges) {
+  std::vector<Polyline> lines;
+  data.flatten(tolerance, lines);
+  for (const auto &line : lines) {
+    size_t n = line.points.size();
+    for (size_t i = 0; i < n; ++i) {
+      const auto &a = line.points[i], &b = line.points[(i + 1) % n];
+      if (a != b) edges.push_back({ a, b, source });
+    }
+  }
+}
+
+static void addSplit(const Edge &e, const vec2 &p, std::vector<Split> &splits) {
+  if (p == e.a || p == e.b) return;
+  vec2 d = e.b - e.a;
+  splits.push_back({ glm::dot(p - e.a, d) / glm::dot(d, d), p });
+}
+
+// Splits both edges where they cross or touch, reusing an endpoint whenever the crossing is at one.
+static void intersect(const Edge &e, const Edge &f, std::vector<Split> &se, std::vector<Split> &sf) {
+  vec2 d1 = e.b - e.a, d2 = f.b - f.a, r = f.a - e.a;
+  float denom = cross(d1, d2);
+  float l1 = glm::length(d1), l2 = glm::length(d2);
+
+  if (fabsf(denom) <= INTERSECT_EPSILON * l1 * l2) {
+    // Parallel edges only interact if they overlap on the same line
+    if (fabsf(cross(r, d1)) > INTERSECT_EPSILON * l1 * std::max(l1, l2)) return;
+    auto within = [](const vec2 &p, const vec2 &a, const vec2 &d) {
+      float t = glm::dot(p - a, d) / glm::dot(d, d);
+      return t > 0.0f && t < 1.0f;
+    };
+    if (within(f.a, e.a, d1)) addSplit(e, f.a, se);
+    if (within(f.b, e.a, d1)) addSplit(e, f.b, se);
+    if (within(e.a, f.a, d2)) addSplit(f, e.a, sf);
+    if (within(e.b, f.a, d2)) addSplit(f, e.b, sf);
+    return;
+  }
+
+  float t = cross(r, d2) / denom, u = cross(r, d1) / denom;
+  const float lo = -INTERSECT_EPSILON, hi = 1.0f + INTERSECT_EPSILON;
+  if (t < lo || t > hi || u < lo || u > hi) return;
+
+  vec2 p;
+  if (fabsf(t) <= INTERSECT_EPSILON) p = e.a;
+  else if (fabsf(t - 1.0f) <= INTERSECT_EPSILON) p = e.b;
+  else if (fabsf(u) <= INTERSECT_EPSILON) p = f.a;
+  else if (fabsf(u - 1.0f) <= INTERSECT_EPSILON) p = f.b;
+  else p = e.a + d1 * t;
+  addSplit(e, p, se);
+  addSplit(f, p, sf);
+}
+
+// Adds the piece from v0 to v1, or adds `delta` to the piece already between them.
+static void addPiece(uint32_t v0, uint32_t v1, const int delta[2], std::vector<Piece> &pieces,
+                     std::unordered_map<uint64_t, size_t> &indices) {
+  uint32_t lo = std::min(v0, v1), hi = std::max(v0, v1);
+  auto inserted = indices.insert({ (static_cast<uint64_t>(lo) << 32) | hi, pieces.size() });
+  if (inserted.second) pieces.push_back({ { lo, hi }, { 0, 0 } });
+  int sign = v0 < v1 ? 1 : -1;
+  auto &piece = pieces[inserted.first->second];
+  piece.delta[0] += sign * delta[0];
+  piece.delta[1] += sign * delta[1];
+}
+
+// Moving crossings onto shared vertices bends the pieces a little, which can make them cross
+// pieces they didn't cross before. Splits the pieces where that happened and returns whether any
+// were found.
+static bool splitCrossings(std::vector<Piece> &pieces, VertexTable &vertices) {
+  auto position = [&](size_t i, int end) -> const vec2 & { return vertices[pieces[i].v[end]]; };
+  std::vector<size_t> order(pieces.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  auto minY = [&](size_t i) { return std::min(position(i, 0).y, position(i, 1).y); };
+  auto maxY = [&](size_t i) { return std::max(position(i, 0).y, position(i, 1).y); };
+  std::sort(order.begin(), order.end(), [&](size_t i, size_t j) { return minY(i) < minY(j); });
+
+  // Split points along each piece from v[0], with their parameter
+  std::vector<std::vector<std::pair<float, uint32_t>>> splits(pieces.size());
+  bool found = false;
+  for (size_t k = 0; k < order.size(); ++k) {
+    size_t i = order[k];
+    const vec2 &a0 = position(i, 0), &a1 = position(i, 1);
+    float x0 = std::min(a0.x, a1.x), x1 = std::max(a0.x, a1.x);
+    for (size_t m = k + 1; m < order.size() && minY(order[m]) <= maxY(i); ++m) {
+      size_t j = order[m];
+      const vec2 &b0 = position(j, 0), &b1 = position(j, 1);
+      if (std::max(b0.x, b1.x) < x0 || std::min(b0.x, b1.x) > x1) continue;
+
+      // Only pieces that properly cross, with the ends of each strictly on either side of the other
+      float c0 = cross(a1 - a0, b0 - a0), c1 = cross(a1 - a0, b1 - a0);
+      float c2 = cross(b1 - b0, a0 - b0), c3 = cross(b1 - b0, a1 - b0);
+      if (!((c0 < 0.0f && c1 > 0.0f) || (c0 > 0.0f && c1 < 0.0f))) continue;
+      if (!((c2 < 0.0f && c3 > 0.0f) || (c2 > 0.0f && c3 < 0.0f))) continue;
+
+      float t = c2 / (c2 - c3), u = c0 / (c0 - c1);
+      uint32_t v = vertices.weld(a0 + (a1 - a0) * t);
+      splits[i].push_back({ t, v });
+      splits[j].push_back({ u, v });
+      found = true;
+    }
+  }
+  if (!found) return false;
+
+  std::vector<Piece> split;
+  std::unordered_map<uint64_t, size_t> indices;
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    auto &points = splits[i];
+    std::sort(points.begin(), points.end());
+    points.push_back({ 1.0f, pieces[i].v[1] });
+    uint32_t v0 = pieces[i].v[0];
+    for (const auto &point : points) {
+      if (point.second == v0) continue;
+      addPiece(v0, point.second, pieces[i].delta, split, indices);
+      v0 = point.second;
+    }
+  }
+  pieces.swap(split);
+  return true;
+}
+
+// Winding numbers of both paths at `p`, by counting signed crossings of a ray towards -x. Pieces
+// that only reach as far left as `p` aren't crossed, so at a vertex with nothing to its left only
+// the pieces of other groups count.
+static void getWindings(const std::vector<Piece> &pieces, const VertexTable &vertices,
+                        const vec2 &p, int winding[2]) {
+  winding[0] = winding[1] = 0;
+  for (const auto &piece : pieces) {
+    const vec2 &a = vertices[piece.v[0]], &b = vertices[piece.v[1]];
+    int sign = 0;
+    if (a.y <= p.y) {
+      if (b.y > p.y && cross(b - a, p - a) < 0.0f) sign = -1;
+    }
+    else if (b.y <= p.y && cross(b - a, p - a) > 0.0f) {
+      sign = 1;
+    }
+    winding[0] += sign * piece.delta[0];
+    winding[1] += sign * piece.delta[1];
+  }
+}
+
+// Whether `b` lies on the straight run from `a` to `c`
+static bool isStraight(const vec2 &a, const vec2 &b, const vec2 &c) {
+  vec2 d0 = b - a, d1 = c - b;
+  return glm::dot(d0, d1) > 0.0f &&
+         fabsf(cross(d0, d1)) <= INTERSECT_EPSILON * glm::length(d0) * glm::length(d1);
+}
+
+static bool isInside(int winding, VGFillRule fillRule) {
+  return fillRule == VG_EVEN_ODD ? (winding & 1) != 0 : winding != 0;
+}
+
+static bool applyOp(PathOp op, bool inA, bool inB) {
+  switch (op) {
+    case PATH_UNION:      return inA || inB;
+    case PATH_INTERSECT:  return inA && inB;
+    case PATH_DIFFERENCE: return inA && !inB;
+    case PATH_XOR:        return inA != inB;
+  }
+  return false;
+}
+
+// The input edges are cut where they cross into pieces between shared vertices, which divide the
+// plane into faces. Each face gets the winding numbers of both paths by stepping across pieces from
+// a face whose winding numbers are counted, so every face is either covered or not, and the pieces
+// between covered and uncovered faces, turned so the covered side is on their left, always join up
+// into closed loops. The loops are traced around the covered faces, so they only touch at vertices.
+//
+// Half-edge 2 * i runs along piece i from v[0] to v[1], and half-edge 2 * i + 1 runs back.
+bool combinePaths(const PathData &a, const PathData &b, PathOp op, VGFillRule fillRule,
+                  float tolerance, PathData &out) {
+  tolerance = std::max(tolerance, 1e-3f);
+
+  std::vector<Edge> edges;
+  addEdges(a, 0, tolerance, edges);
+  addEdges(b, 1, tolerance, edges);
+
+  // Sweep down the edges in order of their top so only edges whose y ranges overlap are tested
+  std::vector<size_t> order(edges.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  auto minY = [&](size_t i) { return std::min(edges[i].a.y, edges[i].b.y); };
+  auto maxY = [&](size_t i) { return std::max(edges[i].a.y, edges[i].b.y); };
+  std::sort(order.begin(), order.end(), [&](size_t i, size_t j) { return minY(i) < minY(j); });
+
+  std::vector<std::vector<Split>> splits(edges.size());
+  for (size_t k = 0; k < order.size(); ++k) {
+    size_t i = order[k];
+    const auto &e = edges[i];
+    float x0 = std::min(e.a.x, e.b.x), x1 = std::max(e.a.x, e.b.x);
+    for (size_t m = k + 1; m < order.size() && minY(order[m]) <= maxY(i); ++m) {
+      size_t j = order[m];
+      const auto &f = edges[j];
+      if (std::max(f.a.x, f.b.x) < x0 || std::min(f.a.x, f.b.x) > x1) continue;
+      intersect(e, f, splits[i], splits[j]);
+    }
+  }
+
+  // The input's own vertices go in first so they are the ones split points are moved onto
+  VertexTable vertices(tolerance * 1e-3f);
+  for (const auto &e : edges) vertices.weld(e.a);
+
+  // Cut the edges into pieces. Edges that overlap, like those shared by both paths, add up into
+  // one piece, and pieces whose edges cancel out don't separate anything.
+  std::vector<Piece> pieces;
+  std::unordered_map<uint64_t, size_t> pieceIndices;
+  for (size_t i = 0; i < edges.size(); ++i) {
+    auto &points = splits[i];
+    std::sort(points.begin(), points.end());
+    points.push_back({ 1.0f, edges[i].b });
+
+    const int delta[2] = { edges[i].source == 0, edges[i].source == 1 };
+    uint32_t v0 = vertices.weld(edges[i].a);
+    for (const auto &split : points) {
+      uint32_t v1 = vertices.weld(split.p);
+      if (v1 == v0) continue;
+      addPiece(v0, v1, delta, pieces, pieceIndices);
+      v0 = v1;
+    }
+  }
+  for (int round = 0; round < MAX_SPLIT_ROUNDS && splitCrossings(pieces, vertices); ++round) {}
+  pieces.erase(std::remove_if(pieces.begin(), pieces.end(), [](const Piece &piece) {
+                 return piece.delta[0] == 0 && piece.delta[1] == 0;
+               }), pieces.end());
+
+  // Order the half-edges leaving each vertex counterclockwise
+  size_t numHalfEdges = pieces.size() * 2;
+  auto origin = [&](size_t h) { return pieces[h / 2].v[h & 1]; };
+  std::vector<std::vector<uint32_t>> around(vertices.size());
+  std::vector<float> angles(numHalfEdges);
+  for (size_t h = 0; h < numHalfEdges; ++h) {
+    vec2 d = vertices[origin(h ^ 1)] - vertices[origin(h)];
+    angles[h] = atan2f(d.y, d.x);
+    around[origin(h)].push_back(static_cast<uint32_t>(h));
+  }
+  std::vector<uint32_t> aroundIndex(numHalfEdges);
+  for (auto &list : around) {
+    std::sort(list.begin(), list.end(), [&](uint32_t g, uint32_t h) {
+      return angles[g] < angles[h];
+    });
+    for (size_t k = 0; k < list.size(); ++k) aroundIndex[list[k]] = static_cast<uint32_t>(k);
+  }
+  // The half-edge after `h` around the face on its left, passing over those `skip` is set for
+  auto nextInFace = [&](size_t h, const std::vector<bool> *skip) {
+    const auto &list = around[origin(h ^ 1)];
+    size_t k = aroundIndex[h ^ 1];
+    do {
+      k = (k + list.size() - 1) % list.size();
+    } while (skip && (*skip)[list[k]] && list[k] != (h ^ 1));
+    return list[k];
+  };
+
+  std::vector<uint32_t> faces(numHalfEdges, UINT32_MAX);
+  uint32_t numFaces = 0;
+  for (size_t first = 0; first < numHalfEdges; ++first) {
+    if (faces[first] != UINT32_MAX) continue;
+    for (size_t h = first; faces[h] == UINT32_MAX; h = nextInFace(h, nullptr)) faces[h] = numFaces;
+    ++numFaces;
+  }
+  std::vector<std::vector<uint32_t>> faceEdges(numFaces);
+  for (size_t h = 0; h < numHalfEdges; ++h) faceEdges[faces[h]].push_back(static_cast<uint32_t>(h));
+
+  // Wind each connected group of pieces starting from the face around it. Going through the
+  // vertices from left to right, the first one of a group has that face on its left, where only
+  // the other groups' pieces count.
+  std::vector<uint32_t> leftToRight(vertices.size());
+  for (uint32_t i = 0; i < leftToRight.size(); ++i) leftToRight[i] = i;
+  std::sort(leftToRight.begin(), leftToRight.end(), [&](uint32_t i, uint32_t j) {
+    const vec2 &p = vertices[i], &q = vertices[j];
+    return p.x < q.x || (p.x == q.x && p.y < q.y);
+  });
+
+  std::vector<std::pair<int, int>> windings(numFaces);
+  std::vector<bool> wound(numFaces, false);
+  std::vector<uint32_t> queue;
+  for (uint32_t v : leftToRight) {
+    // The half-edge at the largest angle has the face left of the vertex on its left
+    if (around[v].empty() || wound[faces[around[v].back()]]) continue;
+    uint32_t outside = faces[around[v].back()];
+    int winding[2];
+    getWindings(pieces, vertices, vertices[v], winding);
+    windings[outside] = { winding[0], winding[1] };
+    wound[outside] = true;
+    queue.assign(1, outside);
+    while (!queue.empty()) {
+      uint32_t face = queue.back();
+      queue.pop_back();
+      for (uint32_t h : faceEdges[face]) {
+        uint32_t other = faces[h ^ 1];
+        if (wound[other]) continue;
+        // `face` is on the left of `h` and `other` on its right
+        const auto &piece = pieces[h / 2];
+        int sign = (h & 1) ? -1 : 1;
+        windings[other] = { windings[face].first - sign * piece.delta[0],
+                            windings[face].second - sign * piece.delta[1] };
+        wound[other] = true;
+        queue.push_back(other);
+      }
+    }
+  }
+
+  std::vector<bool> covered(numFaces);
+  for (uint32_t face = 0; face < numFaces; ++face) {
+    covered[face] = applyOp(op, isInside(windings[face].first, fillRule),
+                            isInside(windings[face].second, fillRule));
+  }
+
+  // Trace around the covered faces, passing over pieces that don't separate them from the rest
+  std::vector<bool> skip(numHalfEdges);
+  for (size_t h = 0; h < numHalfEdges; ++h) skip[h] = covered[faces[h]] == covered[faces[h ^ 1]];
+
+  size_t numSegments = out.segments.size(), numCoords = out.coords.size();
+  std::vector<bool> used(numHalfEdges, false);
+  std::vector<vec2> loop;
+  for (size_t first = 0; first < numHalfEdges; ++first) {
+    if (skip[first] || used[first] || !covered[faces[first]]) continue;
+
+    loop.clear();
+    size_t h = first;
+    do {
+      // Every vertex has as many boundary pieces leaving it as arriving, so a loop can only end
+      // where it started
+      if (used[h] || skip[h] || !covered[faces[h]]) {
+        out.segments.resize(numSegments);
+        out.coords.resize(numCoords);
+        return false;
+      }
+      used[h] = true;
+      // Drop points in the middle of a straight run
+      const vec2 &p = vertices[origin(h)], &next = vertices[origin(h ^ 1)];
+      if (loop.empty() || !isStraight(loop.back(), p, next)) loop.push_back(p);
+      h = nextInFace(h, &skip);
+    } while (h != first);
+    // Pieces that go there and back again cover nothing
+    if (loop.size() >= 3) out.polyline(loop.data(), loop.size(), true);
+  }
+  return true;
+}
+
+} // otto
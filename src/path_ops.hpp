@@ -0,0 +1,24 @@
+#pragma once
+
+#include <VG/openvg.h>
+
+namespace otto {
+
+struct PathData;
+
+enum PathOp {
+  PATH_UNION,
+  PATH_INTERSECT,
+  PATH_DIFFERENCE, // a minus b
+  PATH_XOR
+};
+
+// Appends the outline of the area covered by `op` applied to the filled areas of `a` and `b` to
+// `out` as closed polygons. Both inputs are filled with `fillRule`, with curves flattened to within
+// `tolerance`. The outline doesn't cross itself and its holes wind the other way, so it fills the
+// same under either fill rule. Returns false, leaving `out` as it was, if the outline can't be
+// traced into closed loops.
+bool combinePaths(const PathData &a, const PathData &b, PathOp op, VGFillRule fillRule,
+                  float tolerance, PathData &out);
+
+} // otto
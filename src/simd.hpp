@@ -0,0 +1,9 @@
+#pragma once
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OTTO_GFX_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OTTO_GFX_NEON 1
+#include <arm_neon.h>
+#endif
@@ -0,0 +1,176 @@
+#include "stroker.hpp"
+#include "path_data.hpp"
+
+#include <math.h>
+#include <algorithm>
+
+namespace otto {
+
+using glm::vec2;
+
+static float cross(const vec2 &a, const vec2 &b) {
+  return a.x * b.y - a.y * b.x;
+}
+
+// Left-hand normal of the direction `d`
+static vec2 normal(const vec2 &d) {
+  return vec2(-d.y, d.x);
+}
+
+// Builds the outline of each subpath as one polygon per side. Each side follows the subpath at
+// half the stroke width on its left, so an open subpath becomes a single loop (forward along one
+// side, around the end cap, back along the other and around the start cap) and a closed one two
+// loops in opposite directions, or one if it collapses onto a line. Either way the stroked area is
+// wound clockwise.
+//
+// On the inside of a turn the two offset segments overlap; rather than finding where they cross,
+// the side detours through the vertex itself, which keeps the winding of the overlap non-zero.
+struct Stroker {
+  const StrokeStyle &style;
+  float halfWidth;
+  float tolerance;
+  // Largest angle a round join or cap can turn per line segment
+  float maxArcStep;
+  std::vector<vec2> points, dirs, polygon;
+
+  Stroker(const StrokeStyle &style, float tolerance)
+  : style{ style }, halfWidth{ style.width * 0.5f }, tolerance{ tolerance } {
+    maxArcStep = tolerance < halfWidth ? 2.0f * acosf(1.0f - tolerance / halfWidth)
+                                       : float(M_PI) * 0.5f;
+  }
+
+  // Adds the points between center + from and its rotation by `sweep`, excluding both ends.
+  void addArc(const vec2 &center, const vec2 &from, float sweep) {
+    int steps = static_cast<int>(ceilf(fabsf(sweep) / maxArcStep));
+    for (int k = 1; k < steps; ++k) {
+      float a = sweep * k / steps, c = cosf(a), s = sinf(a);
+      polygon.push_back(center + vec2(from.x * c - from.y * s, from.x * s + from.y * c));
+    }
+  }
+
+  void addJoin(const vec2 &p, const vec2 &d0, const vec2 &d1) {
+    vec2 n0 = normal(d0) * halfWidth, n1 = normal(d1) * halfWidth;
+    vec2 a = p + n0, b = p + n1;
+    if (glm::length(b - a) <= tolerance) {
+      polygon.push_back((a + b) * 0.5f);
+      return;
+    }
+
+    polygon.push_back(a);
+    if (cross(d0, d1) > 0.0f) {
+      // Inside of a left turn
+      polygon.push_back(p);
+    }
+    else if (style.join == VG_JOIN_ROUND) {
+      // Always around the right, like a cap, so a turn straight back doesn't go the inside way
+      addArc(p, n0, -fabsf(atan2f(cross(n0, n1), glm::dot(n0, n1))));
+    }
+    else if (style.join == VG_JOIN_MITER) {
+      // The miter length relative to the width is 1 / cos(turn / 2)
+      float cosHalf = sqrtf(std::max((1.0f + glm::dot(d0, d1)) * 0.5f, 0.0f));
+      if (cosHalf * style.miterLimit >= 1.0f) {
+        polygon.push_back(p + glm::normalize(n0 + n1) * (halfWidth / cosHalf));
+      }
+    }
+    polygon.push_back(b);
+  }
+
+  // Goes from the left of the subpath's end at `p`, heading in `d`, around to its right.
+  void addCap(const vec2 &p, const vec2 &d) {
+    vec2 n = normal(d) * halfWidth;
+    if (style.cap == VG_CAP_SQUARE) {
+      polygon.push_back(p + n + d * halfWidth);
+      polygon.push_back(p - n + d * halfWidth);
+    }
+    else if (style.cap == VG_CAP_ROUND) {
+      addArc(p, n, -float(M_PI));
+    }
+  }
+
+  // Offsets `points` to the left, joining consecutive segments. Closed sides also join the last
+  // segment to the first and leave the loop to be closed by the caller.
+  void addSide(bool closed) {
+    size_t n = points.size();
+    size_t numSegments = closed ? n : n - 1;
+    dirs.resize(numSegments);
+    for (size_t i = 0; i < numSegments; ++i) {
+      dirs[i] = glm::normalize(points[(i + 1) % n] - points[i]);
+    }
+
+    if (closed) {
+      for (size_t i = 0; i < n; ++i) addJoin(points[i], dirs[(i + n - 1) % n], dirs[i]);
+      return;
+    }
+    polygon.push_back(points[0] + normal(dirs[0]) * halfWidth);
+    for (size_t i = 1; i + 1 < n; ++i) addJoin(points[i], dirs[i - 1], dirs[i]);
+    polygon.push_back(points[n - 1] + normal(dirs[numSegments - 1]) * halfWidth);
+  }
+
+  bool isCollapsed() const {
+    vec2 d = glm::normalize(points[1] - points[0]);
+    for (size_t i = 2; i < points.size(); ++i) {
+      if (fabsf(cross(points[i] - points[0], d)) > tolerance * 0.01f) return false;
+    }
+    return true;
+  }
+
+  void emitPolygon(PathData &out) {
+    if (polygon.size() >= 3) out.polyline(polygon.data(), polygon.size(), true);
+    polygon.clear();
+  }
+
+  void stroke(const Polyline &line, PathData &out) {
+    // Repeated points have no direction to offset along
+    points.clear();
+    for (const auto &p : line.points) {
+      if (points.empty() || glm::length(p - points.back()) > tolerance * 0.01f) points.push_back(p);
+    }
+    bool closed = line.closed;
+    if (closed && points.size() > 1 && glm::length(points.back() - points[0]) <= tolerance * 0.01f)
+      points.pop_back();
+
+    if (points.size() == 1) {
+      // Zero-length subpaths only show their caps, drawn as if heading along the x axis
+      if (closed || style.cap == VG_CAP_BUTT) return;
+      vec2 p = points[0], d(1.0f, 0.0f);
+      polygon.push_back(p + normal(d) * halfWidth);
+      addCap(p, d);
+      polygon.push_back(p - normal(d) * halfWidth);
+      addCap(p, -d);
+      emitPolygon(out);
+      return;
+    }
+
+    if (closed) {
+      addSide(true);
+      emitPolygon(out);
+      // A closed subpath that only runs back and forth along a line has no inside: the first side
+      // already goes all the way around it, and the reversed one would cancel it out.
+      if (isCollapsed()) return;
+      std::reverse(points.begin(), points.end());
+      addSide(true);
+      emitPolygon(out);
+      return;
+    }
+
+    addSide(false);
+    addCap(points.back(), dirs.back());
+    std::reverse(points.begin(), points.end());
+    addSide(false);
+    addCap(points.back(), dirs.back());
+    emitPolygon(out);
+  }
+};
+
+void strokeToFill(const PathData &path, const StrokeStyle &style, float tolerance,
+                  std::vector<Polyline> &lines, PathData &out) {
+  if (style.width <= 0.0f) return;
+
+  lines.clear();
+  path.flatten(tolerance, lines);
+
+  Stroker stroker(style, tolerance);
+  for (const auto &line : lines) stroker.stroke(line, out);
+}
+
+} // otto
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <VG/openvg.h>
+
+#include <vector>
+
+namespace otto {
+
+struct PathData;
+struct Polyline;
+
+struct StrokeStyle {
+  float width;
+  VGCapStyle cap;
+  VGJoinStyle join;
+  float miterLimit;
+};
+
+// Appends the outline of `path` stroked with `style` to `out`. The outline is made of closed
+// subpaths that all wind the same way, so filling it with the non-zero rule covers what OpenVG
+// would stroke. Curves and round caps and joins are flattened to within `tolerance`. `lines` holds
+// the flattened path, so passing the same vector each time saves allocating it.
+void strokeToFill(const PathData &path, const StrokeStyle &style, float tolerance,
+                  std::vector<Polyline> &lines, PathData &out);
+
+} // otto
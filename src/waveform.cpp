@@ -0,0 +1,126 @@
+#include "waveform.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+
+namespace otto {
+
+void minMax(const float *samples, size_t count, float &min, float &max) {
+  size_t i = 0;
+  float lo = samples[0], hi = samples[0];
+#if OTTO_GFX_SSE
+  if (count >= 4) {
+    __m128 vlo = _mm_loadu_ps(samples), vhi = vlo;
+    for (i = 4; i + 4 <= count; i += 4) {
+      __m128 v = _mm_loadu_ps(samples + i);
+      vlo = _mm_min_ps(vlo, v);
+      vhi = _mm_max_ps(vhi, v);
+    }
+    float l[4], h[4];
+    _mm_storeu_ps(l, vlo);
+    _mm_storeu_ps(h, vhi);
+    lo = std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+    hi = std::max(std::max(h[0], h[1]), std::max(h[2], h[3]));
+  }
+#elif OTTO_GFX_NEON
+  if (count >= 4) {
+    float32x4_t vlo = vld1q_f32(samples), vhi = vlo;
+    for (i = 4; i + 4 <= count; i += 4) {
+      float32x4_t v = vld1q_f32(samples + i);
+      vlo = vminq_f32(vlo, v);
+      vhi = vmaxq_f32(vhi, v);
+    }
+    float32x2_t l = vpmin_f32(vget_low_f32(vlo), vget_high_f32(vlo));
+    float32x2_t h = vpmax_f32(vget_low_f32(vhi), vget_high_f32(vhi));
+    lo = vget_lane_f32(vpmin_f32(l, l), 0);
+    hi = vget_lane_f32(vpmax_f32(h, h), 0);
+  }
+#endif
+  for (; i < count; ++i) {
+    lo = std::min(lo, samples[i]);
+    hi = std::max(hi, samples[i]);
+  }
+  min = lo;
+  max = hi;
+}
+
+void WaveformSummary::build(const float *samples, size_t count) {
+  levels.clear();
+  size_t numBlocks = count / BLOCK_SIZE;
+  if (numBlocks == 0) return;
+
+  levels.emplace_back(numBlocks * 2);
+  auto *base = levels.back().data();
+  for (size_t b = 0; b < numBlocks; ++b) {
+    minMax(samples + b * BLOCK_SIZE, BLOCK_SIZE, base[b * 2], base[b * 2 + 1]);
+  }
+
+  // Partial groups at the end are left out; range queries scan the level below for them.
+  while (levels.back().size() / 2 >= LEVEL_FANOUT) {
+    const auto &below = levels.back();
+    size_t n = below.size() / 2 / LEVEL_FANOUT;
+    std::vector<float> level(n * 2);
+    for (size_t b = 0; b < n; ++b) {
+      const float *src = below.data() + b * LEVEL_FANOUT * 2;
+      float lo = src[0], hi = src[1];
+      for (size_t k = 1; k < LEVEL_FANOUT; ++k) {
+        lo = std::min(lo, src[k * 2]);
+        hi = std::max(hi, src[k * 2 + 1]);
+      }
+      level[b * 2] = lo;
+      level[b * 2 + 1] = hi;
+    }
+    levels.push_back(std::move(level));
+  }
+}
+
+void WaveformSummary::rangeMinMax(const float *samples, size_t begin, size_t end, float &min,
+                                  float &max) const {
+  float lo = samples[begin], hi = samples[begin];
+  auto scan = [&](const float *s, size_t n) {
+    if (n == 0) return;
+    float l, h;
+    minMax(s, n, l, h);
+    lo = std::min(lo, l);
+    hi = std::max(hi, h);
+  };
+
+  // Raw samples up to the first and from the last block boundary
+  size_t numBlocks = levels.empty() ? 0 : levels[0].size() / 2;
+  size_t a = std::min((begin + BLOCK_SIZE - 1) / BLOCK_SIZE, numBlocks);
+  size_t b = std::max(std::min(end / BLOCK_SIZE, numBlocks), a);
+  if (a == b) {
+    scan(samples + begin, end - begin);
+    min = lo;
+    max = hi;
+    return;
+  }
+  scan(samples + begin, a * BLOCK_SIZE - begin);
+  scan(samples + b * BLOCK_SIZE, end - b * BLOCK_SIZE);
+
+  // Walk up the levels, taking the blocks that don't fill a whole block of the next level
+  auto take = [&](const std::vector<float> &level, size_t block) {
+    lo = std::min(lo, level[block * 2]);
+    hi = std::max(hi, level[block * 2 + 1]);
+  };
+  for (size_t l = 0; a < b; ++l) {
+    const auto &level = levels[l];
+    bool top = l + 1 == levels.size();
+    size_t aboveBlocks = top ? 0 : levels[l + 1].size() / 2;
+    size_t na = top ? b : std::min((a + LEVEL_FANOUT - 1) / LEVEL_FANOUT, aboveBlocks);
+    size_t nb = top ? b : std::max(std::min(b / LEVEL_FANOUT, aboveBlocks), na);
+    if (top || na >= nb) {
+      for (; a < b; ++a) take(level, a);
+      break;
+    }
+    for (; a < na * LEVEL_FANOUT; ++a) take(level, a);
+    for (size_t i = nb * LEVEL_FANOUT; i < b; ++i) take(level, i);
+    a = na;
+    b = nb;
+  }
+
+  min = lo;
+  max = hi;
+}
+
+} // otto
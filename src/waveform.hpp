@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace otto {
+
+// Finds the smallest and largest of `count` samples. `count` must be at least one.
+void minMax(const float *samples, size_t count, float &min, float &max);
+
+// A pyramid of min/max summaries over a sample buffer. Level 0 summarizes blocks of BLOCK_SIZE
+// samples and each further level combines LEVEL_FANOUT blocks of the one below, so the min/max of
+// any range touches at most a few blocks per level plus the raw samples at its unaligned ends.
+struct WaveformSummary {
+  static const size_t BLOCK_SIZE = 16;
+  static const size_t LEVEL_FANOUT = 4;
+
+  // Interleaved min/max pairs per block
+  std::vector<std::vector<float>> levels;
+
+  void build(const float *samples, size_t count);
+  void rangeMinMax(const float *samples, size_t begin, size_t end, float &min, float &max) const;
+};
+
+} // otto
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdio.h>
+
+// Minimal test helpers: CHECK records a failure and carries on, so one run reports every failed
+// expectation. Tests return checkFailures() from main.
+static int failures = 0;
+
+#define CHECK(cond)                                                              \
+  do {                                                                           \
+    if (!(cond)) {                                                               \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);   \
+      ++failures;                                                                \
+    }                                                                            \
+  } while (0)
+
+static inline int checkFailures() {
+  if (failures) fprintf(stderr, "%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+}
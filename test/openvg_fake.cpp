@@ -0,0 +1,228 @@
+#include "openvg_fake.hpp"
+
+#include <string.h>
+#include <map>
+
+namespace fakevg {
+
+namespace {
+
+struct FakePath {
+  VGPathDatatype datatype;
+  VGfloat scale, bias;
+  VGbitfield capabilities;
+  VGint numSegments = 0;
+  std::vector<VGfloat> coords;
+};
+
+struct State {
+  std::map<VGParamType, VGfloat> params = {
+    { VG_MATRIX_MODE, VG_MATRIX_PATH_USER_TO_SURFACE },
+    { VG_FILL_RULE, VG_EVEN_ODD },
+    { VG_STROKE_LINE_WIDTH, 1.0f },
+    { VG_STROKE_CAP_STYLE, VG_CAP_BUTT },
+    { VG_STROKE_JOIN_STYLE, VG_JOIN_MITER },
+    { VG_STROKE_MITER_LIMIT, 4.0f },
+    { VG_MASKING, VG_FALSE },
+    { VG_COLOR_TRANSFORM, VG_FALSE },
+    { VG_BLEND_MODE, VG_BLEND_SRC_OVER },
+  };
+  // Index by matrix mode - VG_MATRIX_PATH_USER_TO_SURFACE
+  VGfloat matrices[5][9];
+  VGPaint fillPaint = VG_INVALID_HANDLE;
+  VGPaint strokePaint = VG_INVALID_HANDLE;
+  VGHandle nextHandle = 1;
+  std::map<VGPath, FakePath> paths;
+  std::vector<Draw> draws;
+  VGErrorCode error = VG_NO_ERROR;
+
+  State() {
+    for (auto &m : matrices) {
+      static const VGfloat identity[] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+      memcpy(m, identity, sizeof(identity));
+    }
+  }
+
+  VGfloat *matrix() {
+    return matrices[static_cast<int>(params[VG_MATRIX_MODE]) - VG_MATRIX_PATH_USER_TO_SURFACE];
+  }
+};
+
+State state;
+
+int getNumCoords(VGubyte segment) {
+  switch (segment & ~VG_RELATIVE) {
+    case VG_CLOSE_PATH: return 0;
+    case VG_HLINE_TO:
+    case VG_VLINE_TO: return 1;
+    case VG_MOVE_TO:
+    case VG_LINE_TO:
+    case VG_SQUAD_TO: return 2;
+    case VG_QUAD_TO:
+    case VG_SCUBIC_TO: return 4;
+    case VG_CUBIC_TO: return 6;
+    default: return 5; // Arcs
+  }
+}
+
+VGfloat readCoord(const FakePath &path, const void *data, size_t i) {
+  VGfloat v;
+  switch (path.datatype) {
+    case VG_PATH_DATATYPE_S_8: v = static_cast<const int8_t *>(data)[i]; break;
+    case VG_PATH_DATATYPE_S_16: v = static_cast<const int16_t *>(data)[i]; break;
+    case VG_PATH_DATATYPE_S_32: v = static_cast<const int32_t *>(data)[i]; break;
+    default: v = static_cast<const VGfloat *>(data)[i]; break;
+  }
+  return v * path.scale + path.bias;
+}
+
+} // namespace
+
+VGint geti(VGParamType type) {
+  return static_cast<VGint>(state.params[type]);
+}
+
+VGfloat getf(VGParamType type) {
+  return state.params[type];
+}
+
+VGPaint getPaint(VGPaintMode paintMode) {
+  return paintMode == VG_FILL_PATH ? state.fillPaint : state.strokePaint;
+}
+
+const std::vector<Draw> &getDraws() {
+  return state.draws;
+}
+
+const std::vector<VGfloat> &getPathCoords(VGPath path) {
+  return state.paths[path].coords;
+}
+
+} // fakevg
+
+using namespace fakevg;
+
+extern "C" {
+
+VGErrorCode vgGetError() {
+  auto error = state.error;
+  state.error = VG_NO_ERROR;
+  return error;
+}
+
+void vgSetf(VGParamType type, VGfloat value) { state.params[type] = value; }
+void vgSeti(VGParamType type, VGint value) { state.params[type] = static_cast<VGfloat>(value); }
+void vgSetfv(VGParamType, VGint, const VGfloat *) {}
+VGfloat vgGetf(VGParamType type) { return state.params[type]; }
+VGint vgGeti(VGParamType type) { return static_cast<VGint>(state.params[type]); }
+
+void vgSetParameteri(VGHandle, VGint, VGint) {}
+void vgSetParameterfv(VGHandle, VGint, VGint, const VGfloat *) {}
+
+VGint vgGetParameteri(VGHandle object, VGint type) {
+  auto &path = state.paths[object];
+  switch (type) {
+    case VG_PATH_DATATYPE: return path.datatype;
+    case VG_PATH_NUM_SEGMENTS: return path.numSegments;
+    case VG_PATH_NUM_COORDS: return static_cast<VGint>(path.coords.size());
+  }
+  return 0;
+}
+
+void vgLoadMatrix(const VGfloat *m) { memcpy(state.matrix(), m, 9 * sizeof(VGfloat)); }
+void vgGetMatrix(VGfloat *m) { memcpy(m, state.matrix(), 9 * sizeof(VGfloat)); }
+
+void vgTranslate(VGfloat tx, VGfloat ty) {
+  auto m = state.matrix();
+  m[6] += m[0] * tx + m[3] * ty;
+  m[7] += m[1] * tx + m[4] * ty;
+}
+
+void vgScale(VGfloat sx, VGfloat sy) {
+  auto m = state.matrix();
+  m[0] *= sx; m[1] *= sx;
+  m[3] *= sy; m[4] *= sy;
+}
+
+void vgMask(VGHandle, VGMaskOperation, VGint, VGint, VGint, VGint) {}
+void vgRenderToMask(VGPath, VGbitfield, VGMaskOperation) {}
+VGMaskLayer vgCreateMaskLayer(VGint, VGint) { return state.nextHandle++; }
+void vgDestroyMaskLayer(VGMaskLayer) {}
+void vgCopyMask(VGMaskLayer, VGint, VGint, VGint, VGint, VGint, VGint) {}
+void vgClear(VGint, VGint, VGint, VGint) {}
+
+VGPath vgCreatePath(VGint, VGPathDatatype datatype, VGfloat scale, VGfloat bias, VGint, VGint,
+                    VGbitfield capabilities) {
+  auto handle = state.nextHandle++;
+  auto &path = state.paths[handle];
+  path.datatype = datatype;
+  path.scale = scale;
+  path.bias = bias;
+  path.capabilities = capabilities;
+  return handle;
+}
+
+void vgClearPath(VGPath handle, VGbitfield capabilities) {
+  auto &path = state.paths[handle];
+  path.capabilities = capabilities;
+  path.numSegments = 0;
+  path.coords.clear();
+}
+
+void vgDestroyPath(VGPath handle) { state.paths.erase(handle); }
+
+void vgRemovePathCapabilities(VGPath handle, VGbitfield capabilities) {
+  state.paths[handle].capabilities &= ~capabilities;
+}
+
+VGbitfield vgGetPathCapabilities(VGPath handle) { return state.paths[handle].capabilities; }
+
+void vgAppendPathData(VGPath handle, VGint numSegments, const VGubyte *segments,
+                      const void *data) {
+  auto &path = state.paths[handle];
+  size_t count = 0;
+  for (VGint i = 0; i < numSegments; ++i) count += getNumCoords(segments[i]);
+  for (size_t i = 0; i < count; ++i) path.coords.push_back(readCoord(path, data, i));
+  path.numSegments += numSegments;
+}
+
+void vgModifyPathCoords(VGPath, VGint, VGint, const void *) {}
+
+VGboolean vgInterpolatePath(VGPath, VGPath, VGPath, VGfloat) { return VG_FALSE; }
+
+VGfloat vgPathLength(VGPath handle, VGint, VGint) {
+  if (!(state.paths[handle].capabilities & VG_PATH_CAPABILITY_PATH_LENGTH)) {
+    state.error = VG_PATH_CAPABILITY_ERROR;
+    return -1.0f;
+  }
+  return 0.0f;
+}
+
+void vgPointAlongPath(VGPath handle, VGint, VGint, VGfloat, VGfloat *, VGfloat *, VGfloat *,
+                      VGfloat *) {
+  if (!(state.paths[handle].capabilities & VG_PATH_CAPABILITY_POINT_ALONG_PATH))
+    state.error = VG_PATH_CAPABILITY_ERROR;
+}
+
+void vgDrawPath(VGPath path, VGbitfield paintModes) {
+  state.draws.push_back({ path, paintModes, state.fillPaint, state.strokePaint,
+                          static_cast<VGint>(state.params[VG_FILL_RULE]),
+                          state.params[VG_STROKE_LINE_WIDTH] });
+}
+
+VGPaint vgCreatePaint() { return state.nextHandle++; }
+void vgDestroyPaint(VGPaint) {}
+
+void vgSetPaint(VGPaint paint, VGbitfield paintModes) {
+  if (paintModes & VG_FILL_PATH) state.fillPaint = paint;
+  if (paintModes & VG_STROKE_PATH) state.strokePaint = paint;
+}
+
+VGPaint vgGetPaint(VGPaintMode paintMode) { return fakevg::getPaint(paintMode); }
+
+VGFont vgCreateFont(VGint) { return state.nextHandle++; }
+void vgSetGlyphToPath(VGFont, VGuint, VGPath, VGboolean, const VGfloat *, const VGfloat *) {}
+void vgDrawGlyphs(VGFont, VGint, const VGuint *, const VGfloat *, const VGfloat *, VGbitfield,
+                  VGboolean) {}
+
+} // extern "C"
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <VG/openvg.h>
+
+#include <vector>
+
+// A stand-in for OpenVG that keeps the context state the library sets and reads, starting from
+// the defaults in the OpenVG 1.1 spec, and records every draw. Paths keep their coordinates so
+// tests can look at the geometry that was uploaded.
+namespace fakevg {
+
+struct Draw {
+  VGPath path;
+  VGbitfield paintModes;
+  VGPaint fillPaint, strokePaint;
+  VGint fillRule;
+  VGfloat strokeWidth;
+};
+
+VGint geti(VGParamType type);
+VGfloat getf(VGParamType type);
+VGPaint getPaint(VGPaintMode paintMode);
+const std::vector<Draw> &getDraws();
+// Coordinates appended to `path`, as floats
+const std::vector<VGfloat> &getPathCoords(VGPath path);
+
+} // fakevg
@@ -0,0 +1,128 @@
+#include "path_data.hpp"
+#include "path_ops.hpp"
+
+#include "check.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace otto;
+using glm::vec2;
+
+static int getWinding(const std::vector<Polyline> &lines, const vec2 &p) {
+  int winding = 0;
+  for (const auto &line : lines) {
+    size_t n = line.points.size();
+    for (size_t i = 0; i < n; ++i) {
+      vec2 a = line.points[i], b = line.points[(i + 1) % n];
+      float side = (b.x - a.x) * (p.y - a.y) - (p.x - a.x) * (b.y - a.y);
+      if (a.y <= p.y) {
+        if (b.y > p.y && side > 0.0f) ++winding;
+      }
+      else if (b.y <= p.y && side < 0.0f) {
+        --winding;
+      }
+    }
+  }
+  return winding;
+}
+
+static bool isNearEdge(const std::vector<Polyline> &lines, const vec2 &p, float distance) {
+  for (const auto &line : lines) {
+    size_t n = line.points.size();
+    for (size_t i = 0; i < n; ++i) {
+      vec2 a = line.points[i], d = line.points[(i + 1) % n] - a;
+      float t = glm::dot(p - a, d) / std::max(glm::dot(d, d), 1e-12f);
+      if (glm::length(p - (a + d * std::min(std::max(t, 0.0f), 1.0f))) < distance) return true;
+    }
+  }
+  return false;
+}
+
+static bool isInside(int winding, VGFillRule fillRule) {
+  return fillRule == VG_EVEN_ODD ? (winding & 1) != 0 : winding != 0;
+}
+
+// Compares the result with `op` applied to the inputs on a grid over [0, 100], away from the edges
+// of the inputs. The result has to fill the same under either fill rule.
+static void checkCombine(const PathData &a, const PathData &b, PathOp op, VGFillRule fillRule) {
+  PathData result;
+  CHECK(combinePaths(a, b, op, fillRule, 0.25f, result));
+
+  std::vector<Polyline> linesA, linesB, linesResult;
+  a.flatten(0.25f, linesA);
+  b.flatten(0.25f, linesB);
+  result.flatten(0.25f, linesResult);
+
+  int wrong = 0;
+  for (float y = 0.25f; y < 100.0f; y += 0.5f) {
+    for (float x = 0.25f; x < 100.0f; x += 0.5f) {
+      vec2 p(x, y);
+      if (isNearEdge(linesA, p, 0.05f) || isNearEdge(linesB, p, 0.05f)) continue;
+      bool inA = isInside(getWinding(linesA, p), fillRule);
+      bool inB = isInside(getWinding(linesB, p), fillRule);
+      bool expected = op == PATH_UNION ? inA || inB : op == PATH_INTERSECT ? inA && inB
+                    : op == PATH_DIFFERENCE ? inA && !inB : inA != inB;
+      int winding = getWinding(linesResult, p);
+      if ((winding != 0) != expected || ((winding & 1) != 0) != expected) ++wrong;
+    }
+  }
+  CHECK(wrong == 0);
+}
+
+// Several crossings close together, where split points computed from different edges used to
+// come out a few bits apart and leave the outline in open pieces.
+static void testCrossingsCloseTogether() {
+  PathData a, b;
+  a.ellipse(58.0f, 34.0f, 18.0f, 24.0f);
+  vec2 triangleA[] = { { 35.0f, 41.0f }, { 75.0f, 71.0f }, { 78.0f, 63.0f } };
+  a.polyline(triangleA, 3, true);
+  vec2 triangleB[] = { { 8.0f, 47.0f }, { 15.0f, 48.0f }, { 78.0f, 57.0f } };
+  b.polyline(triangleB, 3, true);
+
+  for (int op = PATH_UNION; op <= PATH_XOR; ++op) {
+    checkCombine(a, b, PathOp(op), VG_NON_ZERO);
+    checkCombine(a, b, PathOp(op), VG_EVEN_ODD);
+  }
+}
+
+// Every edge overlaps its copy in the other path, and the polygon crosses itself.
+static void testSelfIntersectingWithItself() {
+  PathData a;
+  vec2 points[] = { { 85.0f, 66.0f }, { 17.0f, 51.0f }, { 29.0f, 3.0f }, { 61.0f, 69.0f },
+                    { 58.0f, 3.0f },  { 28.0f, 88.0f }, { 82.0f, 67.0f } };
+  a.polyline(points, 7, true);
+
+  checkCombine(a, a, PATH_UNION, VG_EVEN_ODD);
+  checkCombine(a, a, PATH_INTERSECT, VG_EVEN_ODD);
+  checkCombine(a, a, PATH_UNION, VG_NON_ZERO);
+}
+
+// A copy turned by a fraction of a milliradian crosses the original at shallow angles, where the
+// crossings are furthest from where rounding puts them.
+static void testNearlyCoincidentCopy() {
+  PathData a, b;
+  vec2 points[] = { { 29.017f, 84.442f }, { 68.208f, 96.362f }, { 71.382f, 70.681f },
+                    { 82.968f, 15.231f }, { 63.384f, 63.534f }, { 83.138f, 56.468f },
+                    { 54.838f, 74.999f }, { 30.048f, 74.316f }, { 34.510f, 76.255f },
+                    { 53.561f, 3.178f } };
+  a.polyline(points, 10, true);
+  a.ellipse(11.971f, 78.709f, 20.5895f, 19.997f);
+  for (auto &p : points) {
+    vec2 d = p - vec2(50.0f);
+    p = vec2(50.0f) + vec2(d.x - d.y * 2e-4f, d.y + d.x * 2e-4f);
+  }
+  std::reverse(points, points + 10);
+  b.polyline(points, 10, true);
+
+  for (int op = PATH_UNION; op <= PATH_XOR; ++op) {
+    checkCombine(a, b, PathOp(op), VG_EVEN_ODD);
+  }
+}
+
+int main() {
+  testCrossingsCloseTogether();
+  testSelfIntersectingWithItself();
+  testNearlyCoincidentCopy();
+  return checkFailures();
+}
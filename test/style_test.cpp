@@ -0,0 +1,65 @@
+#include "gfx.hpp"
+
+#include "check.hpp"
+#include "openvg_fake.hpp"
+
+using namespace otto;
+
+// Runs first, while nothing has been set through the library yet, so the style it saves is only
+// known to OpenVG.
+static void testBatchOnFreshContext() {
+  Rect rects[] = { { 0.0f, 0.0f, 10.0f, 10.0f }, { 5.0f, 5.0f, 10.0f, 10.0f } };
+  fillRects(rects, 2, 0xff0000ffu);
+
+  CHECK(fakevg::getDraws().size() == 1);
+  CHECK(fakevg::getDraws().back().fillRule == VG_NON_ZERO);
+  CHECK(fakevg::getDraws().back().fillPaint != VG_INVALID_HANDLE);
+  CHECK(fakevg::getPaint(VG_FILL_PATH) == VG_INVALID_HANDLE);
+  CHECK(fakevg::geti(VG_FILL_RULE) == VG_EVEN_ODD);
+  CHECK(getFillRule() == VG_EVEN_ODD);
+
+  vec2 centers[] = { { 0.0f, 0.0f } };
+  float radii[] = { 5.0f };
+  fillCircles(centers, radii, 1, 0xff00ff00u);
+  CHECK(fakevg::getPaint(VG_FILL_PATH) == VG_INVALID_HANDLE);
+  CHECK(fakevg::geti(VG_FILL_RULE) == VG_EVEN_ODD);
+}
+
+static void testScopedStateOnFreshContext() {
+  {
+    ScopedFillRule rule(VG_NON_ZERO);
+    CHECK(fakevg::geti(VG_FILL_RULE) == VG_NON_ZERO);
+  }
+  CHECK(fakevg::geti(VG_FILL_RULE) == VG_EVEN_ODD);
+
+  {
+    ScopedStyle style;
+    strokeWidth(5.0f);
+    strokeCap(VG_CAP_ROUND);
+    strokeColor(0.0f, 1.0f, 0.0f);
+    enableMask();
+  }
+  CHECK(fakevg::getf(VG_STROKE_LINE_WIDTH) == 1.0f);
+  CHECK(fakevg::geti(VG_STROKE_CAP_STYLE) == VG_CAP_BUTT);
+  CHECK(fakevg::geti(VG_MASKING) == VG_FALSE);
+  CHECK(fakevg::getPaint(VG_STROKE_PATH) == VG_INVALID_HANDLE);
+}
+
+static void testBatchRestoresStyle() {
+  fillColor(0.0f, 0.0f, 1.0f);
+  fillRuleEvenOdd();
+  VGPaint paint = fakevg::getPaint(VG_FILL_PATH);
+
+  Rect rect(0.0f, 0.0f, 10.0f, 10.0f);
+  fillRects(&rect, 1, 0xff0000ffu);
+  CHECK(fakevg::getDraws().back().fillPaint != paint);
+  CHECK(fakevg::getPaint(VG_FILL_PATH) == paint);
+  CHECK(fakevg::geti(VG_FILL_RULE) == VG_EVEN_ODD);
+}
+
+int main() {
+  testBatchOnFreshContext();
+  testScopedStateOnFreshContext();
+  testBatchRestoresStyle();
+  return checkFailures();
+}